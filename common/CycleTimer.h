@@ -21,8 +21,15 @@
 #  include <string.h>
 #  include <sys/time.h>
 #  include <time.h>
+#  if defined(__x86_64__)
+#    include <cpuid.h>
+#  endif
 #endif
 
+// how long the tick rate is measured against the monotonic clock on
+// first use, where it cannot be read from the hardware
+#define CYCLETIMER_CALIBRATION_NS 10000000ULL
+
 
   // This uses the cycle counter of the processor.  Different
   // processors in the system will have different values for this.  If
@@ -35,9 +42,28 @@
   // Also note that if you processors' speeds change (i.e. processors
   // scaling) or if you are in a heterogenous environment, you will
   // likely get spurious results.
+  //
+  // On x86 Linux the tick rate is calibrated against CLOCK_MONOTONIC
+  // on first use.  When the TSC is invariant (constant rate across
+  // frequency changes and sleep states), and on aarch64 where the
+  // generic timer always is, currentNanos() converts ticks to
+  // nanoseconds with integer arithmetic instead of calling into the
+  // kernel; otherwise it falls back to clock_gettime().
   class CycleTimer {
   public:
     typedef unsigned long long SysClock;
+    typedef unsigned long long Nanos;
+
+    // cost and granularity of the clock, see selfTest()
+    typedef struct {
+      const char* source;
+      // nominal length of one tick
+      double tick_ns;
+      // smallest nonzero step seen between two currentNanos() calls
+      double resolution_ns;
+      // mean cost of one currentNanos() call
+      double overhead_ns;
+    } SelfTestResult;
 
     //////////
     // Return the current CPU time, in terms of clock ticks.
@@ -54,6 +80,11 @@
       asm volatile("rdtsc" : "=a" (a), "=d" (d));
       return static_cast<unsigned long long>(a) |
         (static_cast<unsigned long long>(d) << 32);
+#elif defined(__aarch64__)
+      // the generic timer's virtual count, readable from user space
+      unsigned long long val;
+      asm volatile("mrs %0, cntvct_el0" : "=r"(val));
+      return val;
 #elif defined(__ARM_NEON__) && 0 // mrc requires superuser.
       unsigned int val;
       asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(val));
@@ -62,14 +93,61 @@
       // Use clock_gettime with CLOCK_MONOTONIC_RAW for high-resolution timing
       timespec spec;
       clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
-      return static_cast<unsigned long long>(spec.tv_sec) * 1e9 + spec.tv_nsec;
+      return static_cast<SysClock>(spec.tv_sec) * 1000000000ULL + spec.tv_nsec;
 #else
-      timespec spec;
-      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &spec);
-      return CycleTimer::SysClock(static_cast<float>(spec.tv_sec) * 1e9 + static_cast<float>(spec.tv_nsec));
+      return monotonicNanos();
 #endif
     }
 
+    //////////
+    // Return a monotonic time in integer nanoseconds.  Time zero is at
+    // some arbitrary point in the past, the same for all threads.
+    static Nanos currentNanos() {
+      const Calibration& c = calibration();
+      if (!c.fast_nanos) {
+        return monotonicNanos();
+      }
+      return ticksToNanos(currentTicks());
+    }
+
+    //////////
+    // Convert a number of ticks, or a difference of two currentTicks()
+    // values, to nanoseconds.
+    static Nanos ticksToNanos(SysClock ticks) {
+      const Calibration& c = calibration();
+#if defined(__SIZEOF_INT128__)
+      // 32.32 fixed point, so that large tick counts keep full precision
+      return static_cast<Nanos>((static_cast<unsigned __int128>(ticks) * c.nanos_per_tick_fp) >> 32);
+#else
+      return static_cast<Nanos>(static_cast<double>(ticks) * c.seconds_per_tick * 1e9);
+#endif
+    }
+
+    //////////
+    // Measure the clock behind currentNanos(): its source, the length
+    // of a tick, the smallest step two consecutive calls observe, and
+    // the mean cost of a call, which callers timing short intervals
+    // can subtract from their measurements.
+    static SelfTestResult selfTest(int calls = 100000) {
+      SelfTestResult r;
+      r.source = calibration().source;
+      r.tick_ns = secondsPerTick() * 1e9;
+
+      Nanos start = currentNanos();
+      Nanos last = start;
+      Nanos min_step = ~0ULL;
+      for (int i = 0; i < calls; i++) {
+        Nanos now = currentNanos();
+        if (now != last && now - last < min_step) {
+          min_step = now - last;
+        }
+        last = now;
+      }
+      r.overhead_ns = static_cast<double>(last - start) / calls;
+      r.resolution_ns = min_step == ~0ULL ? 0.0 : static_cast<double>(min_step);
+      return r;
+    }
+
     //////////
     // Return the current CPU time, in terms of seconds.
     // This is slower than currentTicks().  Time zero is at
@@ -89,6 +167,8 @@
       return "ns";
 #elif defined(__WIN32__) || defined(__x86_64__)
       return "cycles";
+#elif defined(__aarch64__)
+      return "ticks"; // cntvct_el0
 #else
       return "ns"; // clock_gettime
 #endif
@@ -97,87 +177,111 @@
     //////////
     // Return the conversion from ticks to seconds.
     static double secondsPerTick() {
-      static bool initialized = false;
-      static double secondsPerTick_val;
-      if (initialized) return secondsPerTick_val;
+      return calibration().seconds_per_tick;
+    }
+
+    //////////
+    // Return the conversion from ticks to milliseconds.
+    static double msPerTick() {
+      return secondsPerTick() * 1000.0;
+    }
+
+  private:
+    CycleTimer();
+
+    typedef struct {
+      double seconds_per_tick;
+      // nanoseconds per tick in 32.32 fixed point
+      unsigned long long nanos_per_tick_fp;
+      // whether currentNanos() may use ticks instead of the OS clock
+      bool fast_nanos;
+      const char* source;
+    } Calibration;
+
+    static Nanos monotonicNanos() {
+#if defined(_WIN32) || (defined(__APPLE__) && !defined(__x86_64__))
+      return ticksToNanos(currentTicks());
+#else
+      timespec spec;
+      clock_gettime(CLOCK_MONOTONIC, &spec);
+      return static_cast<Nanos>(spec.tv_sec) * 1000000000ULL + spec.tv_nsec;
+#endif
+    }
+
+    // a (monotonic ns, ticks) pair, taking the ticks halfway between
+    // the two reads that most tightly bracket the clock_gettime() call
+    static void sampleClocks(Nanos* ns, SysClock* ticks) {
+      SysClock best = ~0ULL;
+      for (int i = 0; i < 8; i++) {
+        SysClock before = currentTicks();
+        Nanos now = monotonicNanos();
+        SysClock after = currentTicks();
+        if (after - before < best) {
+          best = after - before;
+          *ns = now;
+          *ticks = before + (after - before) / 2;
+        }
+      }
+    }
+
+    // computed once, on first use, by whichever thread gets there first
+    static const Calibration& calibration() {
+      static const Calibration c = calibrate();
+      return c;
+    }
+
+    static Calibration calibrate() {
+      Calibration c;
+      c.fast_nanos = true;
+      c.source = "clock_gettime(CLOCK_MONOTONIC)";
 #if defined(__APPLE__)
   #ifdef __x86_64__
       int args[] = {CTL_HW, HW_CPU_FREQ};
       unsigned int Hz;
       size_t len = sizeof(Hz);
       if (sysctl(args, 2, &Hz, &len, NULL, 0) != 0) {
-         fprintf(stderr, "Failed to initialize secondsPerTick_val!\n");
+         fprintf(stderr, "Failed to initialize secondsPerTick!\n");
          exit(-1);
       }
-      secondsPerTick_val = 1.0 / (double) Hz;
+      c.seconds_per_tick = 1.0 / (double) Hz;
+      c.source = "TSC";
   #else
       mach_timebase_info_data_t time_info;
       mach_timebase_info(&time_info);
 
       // Scales to nanoseconds without 1e-9f
-      secondsPerTick_val = (1e-9*static_cast<double>(time_info.numer))/
+      c.seconds_per_tick = (1e-9*static_cast<double>(time_info.numer))/
         static_cast<double>(time_info.denom);
+      c.source = "mach_absolute_time";
   #endif // x86_64 or not
 #elif defined(_WIN32)
       LARGE_INTEGER qwTicksPerSec;
       QueryPerformanceFrequency(&qwTicksPerSec);
-      secondsPerTick_val = 1.0/static_cast<double>(qwTicksPerSec.QuadPart);
-#else
-      FILE *fp = fopen("/proc/cpuinfo","r");
-      char input[1024];
-      if (!fp) {
-         fprintf(stderr, "CycleTimer::resetScale failed: couldn't find /proc/cpuinfo.");
-         exit(-1);
-      }
-      // In case we don't find it, e.g. on the N900
-      secondsPerTick_val = 1e-9;
-      while (!feof(fp) && fgets(input, 1024, fp)) {
-        // NOTE(boulos): Because reading cpuinfo depends on dynamic
-        // frequency scaling it's better to read the @ sign first
-        float GHz, MHz;
-        if (strstr(input, "model name")) {
-          char* at_sign = strstr(input, "@");
-          if (at_sign) {
-            char* after_at = at_sign + 1;
-            char* GHz_str = strstr(after_at, "GHz");
-            char* MHz_str = strstr(after_at, "MHz");
-            if (GHz_str) {
-              *GHz_str = '\0';
-              if (1 == sscanf(after_at, "%f", &GHz)) {
-                //printf("GHz = %f\n", GHz);
-                secondsPerTick_val = 1e-9f / GHz;
-                break;
-              }
-            } else if (MHz_str) {
-              *MHz_str = '\0';
-              if (1 == sscanf(after_at, "%f", &MHz)) {
-                //printf("MHz = %f\n", MHz);
-                secondsPerTick_val = 1e-6f / MHz;
-                break;
-              }
-            }
-          }
-        } else if (1 == sscanf(input, "cpu MHz : %f", &MHz)) {
-          //printf("MHz = %f\n", MHz);
-          secondsPerTick_val = 1e-6f / MHz;
-          break;
-        }
+      c.seconds_per_tick = 1.0/static_cast<double>(qwTicksPerSec.QuadPart);
+      c.source = "QueryPerformanceCounter";
+#elif defined(__x86_64__)
+      Nanos ns0 = 0, ns1 = 0;
+      SysClock ticks0 = 0, ticks1 = 0;
+      sampleClocks(&ns0, &ticks0);
+      while (monotonicNanos() - ns0 < CYCLETIMER_CALIBRATION_NS) {
       }
-      fclose(fp);
+      sampleClocks(&ns1, &ticks1);
+      c.seconds_per_tick = 1e-9 * static_cast<double>(ns1 - ns0) / static_cast<double>(ticks1 - ticks0);
+      unsigned int eax, ebx, ecx, edx;
+      c.fast_nanos = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8));
+      c.source = c.fast_nanos ? "invariant TSC" : "clock_gettime(CLOCK_MONOTONIC)";
+#elif defined(__aarch64__)
+      unsigned long long frequency;
+      asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+      c.seconds_per_tick = 1.0 / static_cast<double>(frequency);
+      c.source = "cntvct_el0";
+#else
+      // ticks are nanoseconds from clock_gettime()
+      c.seconds_per_tick = 1e-9;
 #endif
-
-      initialized = true;
-      return secondsPerTick_val;
-    }
-
-    //////////
-    // Return the conversion from ticks to milliseconds.
-    static double msPerTick() {
-      return secondsPerTick() * 1000.0;
+      c.nanos_per_tick_fp = static_cast<unsigned long long>(c.seconds_per_tick * 1e9 * 4294967296.0 + 0.5);
+      return c;
     }
-
-  private:
-    CycleTimer();
   };
 
 #endif // #ifndef _SYRAH_CYCLE_TIMER_H_
@@ -0,0 +1,8 @@
+#ifndef _CACHELINE_H
+#define _CACHELINE_H
+
+// size, in bytes, that per-thread data is padded and aligned to so that
+// threads do not false-share
+#define CACHE_LINE_SIZE 64
+
+#endif
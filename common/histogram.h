@@ -0,0 +1,93 @@
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+/*
+ * Log-linear latency histogram in the style of HdrHistogram.  Values
+ * below 2^HISTOGRAM_SUB_BUCKET_BITS are counted exactly; above that
+ * every power of two is split into 2^HISTOGRAM_SUB_BUCKET_BITS equal
+ * buckets, so a reported percentile is within 1/16 (6.25%) of the
+ * recorded value.  The unit is whatever the caller records (e.g.
+ * CycleTimer ticks).
+ *
+ * record() may be called concurrently from any number of threads.
+ */
+
+#include <atomic>
+
+#define HISTOGRAM_SUB_BUCKET_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+class LatencyHistogram {
+    private:
+        std::atomic<long long> counts[HISTOGRAM_BUCKETS];
+        std::atomic<long long> total;
+        std::atomic<unsigned long long> max;
+
+        static int bucket(unsigned long long value) {
+            if (value < HISTOGRAM_SUB_BUCKETS) return value;
+            int msb = 63 - __builtin_clzll(value);
+            int magnitude = msb - HISTOGRAM_SUB_BUCKET_BITS + 1;
+            int sub = (value >> (magnitude - 1)) - HISTOGRAM_SUB_BUCKETS;
+            return magnitude * HISTOGRAM_SUB_BUCKETS + sub;
+        }
+
+        // largest value counted in bucket `index`
+        static unsigned long long highest_value(int index) {
+            int magnitude = index / HISTOGRAM_SUB_BUCKETS;
+            if (magnitude == 0) return index;
+            unsigned long long lowest =
+                (unsigned long long) (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS)
+                << (magnitude - 1);
+            return lowest + (1ULL << (magnitude - 1)) - 1;
+        }
+
+    public:
+        LatencyHistogram() {
+            reset();
+        }
+
+        void reset() {
+            for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+                counts[i] = 0;
+            }
+            total = 0;
+            max = 0;
+        }
+
+        void record(unsigned long long value) {
+            counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+            total.fetch_add(1, std::memory_order_relaxed);
+            unsigned long long prev = max.load(std::memory_order_relaxed);
+            while (value > prev &&
+                   !max.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {}
+        }
+
+        long long count() {
+            return total;
+        }
+
+        unsigned long long maximum() {
+            return max;
+        }
+
+        // smallest bucket bound covering `fraction` (0..1] of the
+        // recorded values, capped at the exact maximum
+        unsigned long long percentile(double fraction) {
+            long long n = total;
+            if (n == 0) return 0;
+            long long target = (long long) (fraction * n);
+            if (target < fraction * n || target < 1) target++;
+            long long seen = 0;
+            for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+                seen += counts[i];
+                if (seen >= target) {
+                    unsigned long long value = highest_value(i);
+                    return value < max ? value : (unsigned long long) max;
+                }
+            }
+            return max;
+        }
+};
+
+#endif
@@ -0,0 +1,498 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vector>
+#include <stdint.h>
+#include "itasksys.h"
+#include "cacheline.h"
+
+/*
+ * Data-parallel helpers built on ITaskSystem.  The loop body's type is
+ * a template parameter, so the per-element loop inside each chunk is
+ * compiled with the body inlined; the only virtual call left is one
+ * runTaskRange() per chunk the task system claims.  Scheduling and
+ * dependencies are whatever the underlying task system provides.
+ */
+
+// chunks per launch when the caller does not ask for a specific count
+#define PARALLEL_DEFAULT_NUM_CHUNKS 64
+
+// iterations claimed at a time by each slot of a parallel_reduce()
+#define PARALLEL_REDUCE_CLAIMS_PER_SLOT 16
+
+/*
+ * ParallelForRunnable: runs body(i) for every i in [0, n).  Task
+ * `task_id` of the bulk launch handles the task_id-th contiguous chunk.
+ */
+template <typename Body>
+class ParallelForRunnable: public IRunnable {
+    public:
+        ParallelForRunnable(int n, const Body& body) : n_(n), body_(body) {}
+        ~ParallelForRunnable() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            runTaskRange(task_id, task_id + 1, num_total_tasks);
+        }
+
+        // a claimed block of tasks is one contiguous run of iterations
+        void runTaskRange(int begin, int end, int num_total_tasks) {
+            int elements_per_task = (n_ + num_total_tasks-1) / num_total_tasks;
+            int start = std::min(elements_per_task * begin, n_);
+            int stop = std::min(elements_per_task * end, n_);
+
+            for (int i = start; i < stop; i++) {
+                body_(i);
+            }
+        }
+
+    private:
+        int n_;
+        Body body_;
+};
+
+/*
+ * Runs body(i) for every i in [0, n) as one bulk launch of at most
+ * num_chunks tasks, returning once all iterations are complete.
+ */
+template <typename Body>
+void parallel_for(ITaskSystem* t, int n, const Body& body,
+                  int num_chunks = PARALLEL_DEFAULT_NUM_CHUNKS) {
+    if (n <= 0) {
+        return;
+    }
+    ParallelForRunnable<Body> runnable(n, body);
+    t->run(&runnable, std::min(n, num_chunks));
+}
+
+/*
+ * Asynchronous form of parallel_for(): the launch starts once `deps`
+ * complete, and its TaskID is returned for use in later dependencies.
+ * The runnable is owned by the launch and freed by a then()
+ * continuation, so `body` must stay valid until the launch completes.
+ */
+template <typename Body>
+TaskID parallel_for_async(ITaskSystem* t, int n, const Body& body,
+                          const std::vector<TaskID>& deps,
+                          int num_chunks = PARALLEL_DEFAULT_NUM_CHUNKS) {
+    ParallelForRunnable<Body>* runnable = new ParallelForRunnable<Body>(n, body);
+    TaskID task_id = t->runAsyncWithDeps(runnable, std::max(1, std::min(n, num_chunks)), deps);
+    t->then(task_id, [runnable]{ delete runnable; });
+    return task_id;
+}
+
+/*
+ * CacheAlignedArray: fixed-size array whose elements each start on
+ * their own cache line, so that threads updating neighbouring elements
+ * do not false-share.
+ */
+template <typename T>
+class CacheAlignedArray {
+    public:
+        CacheAlignedArray(int n, const T& init) : n_(n) {
+            stride_ = (sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+            raw_ = new char[stride_ * n + CACHE_LINE_SIZE];
+            uintptr_t misalign = reinterpret_cast<uintptr_t>(raw_) % CACHE_LINE_SIZE;
+            base_ = raw_ + (misalign ? CACHE_LINE_SIZE - misalign : 0);
+            for (int i = 0; i < n_; i++) {
+                new (base_ + i * stride_) T(init);
+            }
+        }
+        ~CacheAlignedArray() {
+            for (int i = 0; i < n_; i++) {
+                (*this)[i].~T();
+            }
+            delete [] raw_;
+        }
+
+        T& operator[](int i) { return *reinterpret_cast<T*>(base_ + i * stride_); }
+        int size() const { return n_; }
+
+    private:
+        CacheAlignedArray(const CacheAlignedArray&);
+        CacheAlignedArray& operator=(const CacheAlignedArray&);
+
+        int n_;
+        size_t stride_;
+        char* raw_;
+        char* base_;
+};
+
+/*
+ * ParallelReduceRunnable: folds map(i) for i in [0, n) into one
+ * partial per task using combine().
+ *
+ * By default each task is a slot that keeps claiming blocks of
+ * iterations from a shared counter until none are left, so whichever
+ * thread runs a slot accumulates as much as it can into it.  Which
+ * iterations land in which slot depends on timing.
+ *
+ * In deterministic mode task k instead owns the fixed k-th contiguous
+ * chunk of iterations, so every partial is the same from run to run.
+ */
+template <typename T, typename Map, typename Combine>
+class ParallelReduceRunnable: public IRunnable {
+    public:
+        ParallelReduceRunnable(int n, const T& identity, const Map& map,
+                               const Combine& combine, bool deterministic,
+                               int num_tasks)
+          : n_(n), identity_(identity), map_(map), combine_(combine),
+            deterministic_(deterministic), next_(0),
+            grain_(std::max(1, n / (num_tasks * PARALLEL_REDUCE_CLAIMS_PER_SLOT))),
+            partials_(num_tasks, identity) {}
+        ~ParallelReduceRunnable() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            runTaskRange(task_id, task_id + 1, num_total_tasks);
+        }
+
+        void runTaskRange(int begin, int end, int num_total_tasks) {
+            if (deterministic_) {
+                int elements_per_task = (n_ + num_total_tasks-1) / num_total_tasks;
+                for (int task = begin; task < end; task++) {
+                    int start = std::min(elements_per_task * task, n_);
+                    int stop = std::min(start + elements_per_task, n_);
+                    partials_[task] = fold(start, stop, identity_);
+                }
+                return;
+            }
+
+            // the whole claimed block runs on this thread: use one slot
+            T acc = partials_[begin];
+            while (true) {
+                int start = next_.fetch_add(grain_);
+                if (start >= n_) break;
+                acc = fold(start, std::min(start + grain_, n_), acc);
+            }
+            partials_[begin] = acc;
+        }
+
+        /*
+         * Combines the partials once the launch has completed: in slot
+         * order by default, or in a fixed pairwise tree in deterministic
+         * mode so that floating-point results are reproducible.
+         */
+        T result() {
+            int num = partials_.size();
+            if (!deterministic_) {
+                T acc = identity_;
+                for (int i = 0; i < num; i++) {
+                    acc = combine_(acc, partials_[i]);
+                }
+                return acc;
+            }
+            for (int stride = 1; stride < num; stride *= 2) {
+                for (int i = 0; i + stride < num; i += 2 * stride) {
+                    partials_[i] = combine_(partials_[i], partials_[i + stride]);
+                }
+            }
+            return partials_[0];
+        }
+
+    private:
+        T fold(int start, int stop, T acc) {
+            for (int i = start; i < stop; i++) {
+                acc = combine_(acc, map_(i));
+            }
+            return acc;
+        }
+
+        int n_;
+        T identity_;
+        Map map_;
+        Combine combine_;
+        bool deterministic_;
+        std::atomic<int> next_;
+        int grain_;
+        CacheAlignedArray<T> partials_;
+};
+
+/*
+ * Returns identity combined with map(i) for every i in [0, n).
+ * combine() must be associative and `identity` its identity element.
+ * Partials are accumulated into cache-line-aligned slots during one
+ * bulk launch of num_chunks tasks and merged once it completes.
+ *
+ * Pass deterministic = true to get the same result bit-for-bit on
+ * every run and every task system (for a given num_chunks), e.g. for
+ * floating-point sums; this gives up the dynamic load balancing of
+ * the default mode.
+ */
+template <typename T, typename Map, typename Combine>
+T parallel_reduce(ITaskSystem* t, int n, const T& identity, const Map& map,
+                  const Combine& combine, bool deterministic = false,
+                  int num_chunks = PARALLEL_DEFAULT_NUM_CHUNKS) {
+    if (n <= 0) {
+        return identity;
+    }
+    int num_tasks = std::min(n, num_chunks);
+    ParallelReduceRunnable<T, Map, Combine> runnable(n, identity, map, combine,
+                                                     deterministic, num_tasks);
+    t->run(&runnable, num_tasks);
+    return runnable.result();
+}
+
+/*
+ * ParallelScanRunnable: one pass of a blocked prefix scan over
+ * [0, n).  Task k owns the k-th contiguous block.  The first pass
+ * writes the total of each block into block_sums; the second pass
+ * scans each block in place into output, starting from the carry the
+ * caller stored in block_sums for that block.
+ */
+template <typename T, typename Op>
+class ParallelScanRunnable: public IRunnable {
+    public:
+        ParallelScanRunnable(int n, const T* input, T* output,
+                             const T& identity, const Op& op, bool inclusive,
+                             CacheAlignedArray<T>& block_sums)
+          : n_(n), input_(input), output_(output), identity_(identity),
+            op_(op), inclusive_(inclusive), block_sums_(block_sums),
+            second_pass_(false) {}
+        ~ParallelScanRunnable() {}
+
+        void startSecondPass() { second_pass_ = true; }
+
+        void runTask(int task_id, int num_total_tasks) {
+            runTaskRange(task_id, task_id + 1, num_total_tasks);
+        }
+
+        void runTaskRange(int begin, int end, int num_total_tasks) {
+            int elements_per_task = (n_ + num_total_tasks-1) / num_total_tasks;
+            for (int task = begin; task < end; task++) {
+                int start = std::min(elements_per_task * task, n_);
+                int stop = std::min(start + elements_per_task, n_);
+                if (second_pass_) {
+                    scanBlock(start, stop, block_sums_[task]);
+                } else {
+                    T acc = identity_;
+                    for (int i = start; i < stop; i++) {
+                        acc = op_(acc, input_[i]);
+                    }
+                    block_sums_[task] = acc;
+                }
+            }
+        }
+
+    private:
+        void scanBlock(int start, int stop, T acc) {
+            if (inclusive_) {
+                for (int i = start; i < stop; i++) {
+                    acc = op_(acc, input_[i]);
+                    output_[i] = acc;
+                }
+            } else {
+                // read before writing so that input == output works
+                for (int i = start; i < stop; i++) {
+                    T x = input_[i];
+                    output_[i] = acc;
+                    acc = op_(acc, x);
+                }
+            }
+        }
+
+        int n_;
+        const T* input_;
+        T* output_;
+        T identity_;
+        Op op_;
+        bool inclusive_;
+        CacheAlignedArray<T>& block_sums_;
+        bool second_pass_;
+};
+
+/*
+ * Writes the prefix scan of input[0, n) under the associative `op`
+ * into output, which may alias input.  Inclusive: output[i] is
+ * identity op input[0] op ... op input[i]; exclusive: it stops at
+ * input[i-1], so output[0] is identity.
+ *
+ * Two bulk launches of num_blocks tasks each: the first reduces every
+ * block into a cache-line-aligned block sum, the caller then turns the
+ * block sums into per-block carries with a short serial scan, and the
+ * second launch scans every block starting from its carry.
+ */
+template <typename T, typename Op>
+void parallel_scan(ITaskSystem* t, int n, const T* input, T* output,
+                   const T& identity, const Op& op, bool inclusive = true,
+                   int num_blocks = PARALLEL_DEFAULT_NUM_CHUNKS) {
+    if (n <= 0) {
+        return;
+    }
+    int num_tasks = std::min(n, num_blocks);
+    CacheAlignedArray<T> block_sums(num_tasks, identity);
+    ParallelScanRunnable<T, Op> runnable(n, input, output, identity, op,
+                                         inclusive, block_sums);
+    t->run(&runnable, num_tasks);
+
+    T carry = identity;
+    for (int i = 0; i < num_tasks; i++) {
+        T block_sum = block_sums[i];
+        block_sums[i] = carry;
+        carry = op(carry, block_sum);
+    }
+
+    runnable.startSecondPass();
+    t->run(&runnable, num_tasks);
+}
+
+template <typename T, typename Op>
+void parallel_inclusive_scan(ITaskSystem* t, int n, const T* input, T* output,
+                             const T& identity, const Op& op,
+                             int num_blocks = PARALLEL_DEFAULT_NUM_CHUNKS) {
+    parallel_scan(t, n, input, output, identity, op, true, num_blocks);
+}
+
+template <typename T, typename Op>
+void parallel_exclusive_scan(ITaskSystem* t, int n, const T* input, T* output,
+                             const T& identity, const Op& op,
+                             int num_blocks = PARALLEL_DEFAULT_NUM_CHUNKS) {
+    parallel_scan(t, n, input, output, identity, op, false, num_blocks);
+}
+
+/*
+ * Order in which parallel_for_2d() hands out the tiles of a 2D domain.
+ * Task i of the launch runs the i-th tile in this order, and task
+ * systems claim tasks in increasing order, so consecutive claims stay
+ * close together in the domain along a Morton or Hilbert curve.
+ */
+enum TileOrder {
+    TILE_ORDER_ROW_MAJOR,
+    TILE_ORDER_MORTON,
+    TILE_ORDER_HILBERT,
+};
+
+// point at distance d along the Hilbert curve filling a side x side
+// square, side a power of two
+inline void hilbertPoint(int side, int d, int* x, int* y) {
+    *x = *y = 0;
+    for (int s = 1; s < side; s *= 2) {
+        int rx = 1 & (d / 2);
+        int ry = 1 & (d ^ rx);
+        if (ry == 0) {
+            if (rx == 1) {
+                *x = s - 1 - *x;
+                *y = s - 1 - *y;
+            }
+            std::swap(*x, *y);
+        }
+        *x += s * rx;
+        *y += s * ry;
+        d /= 4;
+    }
+}
+
+/*
+ * Returns the tiles of a tiles_x by tiles_y grid, as ty * tiles_x + tx,
+ * in the given order.  Morton and Hilbert curves walk the smallest
+ * enclosing power-of-two square and skip the points outside the grid.
+ */
+inline std::vector<int> tileOrder(int tiles_x, int tiles_y, TileOrder order) {
+    std::vector<int> tiles;
+    tiles.reserve(tiles_x * tiles_y);
+    if (order == TILE_ORDER_ROW_MAJOR) {
+        for (int i = 0; i < tiles_x * tiles_y; i++) {
+            tiles.push_back(i);
+        }
+        return tiles;
+    }
+    int side = 1;
+    while (side < tiles_x || side < tiles_y) {
+        side *= 2;
+    }
+    for (int d = 0; d < side * side; d++) {
+        int x = 0, y = 0;
+        if (order == TILE_ORDER_MORTON) {
+            for (int bit = 0; (1 << bit) < side; bit++) {
+                x |= ((d >> (2 * bit)) & 1) << bit;
+                y |= ((d >> (2 * bit + 1)) & 1) << bit;
+            }
+        } else {
+            hilbertPoint(side, d, &x, &y);
+        }
+        if (x < tiles_x && y < tiles_y) {
+            tiles.push_back(y * tiles_x + x);
+        }
+    }
+    return tiles;
+}
+
+/*
+ * ParallelFor2DRunnable: runs body(x_begin, x_end, y_begin, y_end) for
+ * every tile_w by tile_h tile of a width by height domain, one tile per
+ * task, visiting tiles in a precomputed TileOrder.  Edge tiles are
+ * clipped to the domain.
+ */
+template <typename Body>
+class ParallelFor2DRunnable: public IRunnable {
+    public:
+        ParallelFor2DRunnable(int width, int height, int tile_w, int tile_h,
+                              TileOrder order, const Body& body)
+          : width_(width), height_(height), tile_w_(tile_w), tile_h_(tile_h),
+            tiles_x_((width + tile_w - 1) / tile_w), body_(body) {
+            tiles_ = tileOrder(tiles_x_, (height + tile_h - 1) / tile_h, order);
+        }
+        ~ParallelFor2DRunnable() {}
+
+        int numTiles() const { return tiles_.size(); }
+
+        void runTask(int task_id, int num_total_tasks) {
+            runTaskRange(task_id, task_id + 1, num_total_tasks);
+        }
+
+        void runTaskRange(int begin, int end, int num_total_tasks) {
+            // an async launch of an empty domain still has one task
+            end = std::min(end, numTiles());
+            for (int i = begin; i < end; i++) {
+                int x = tiles_[i] % tiles_x_ * tile_w_;
+                int y = tiles_[i] / tiles_x_ * tile_h_;
+                body_(x, std::min(x + tile_w_, width_), y, std::min(y + tile_h_, height_));
+            }
+        }
+
+    private:
+        int width_;
+        int height_;
+        int tile_w_;
+        int tile_h_;
+        int tiles_x_;
+        std::vector<int> tiles_;
+        Body body_;
+};
+
+/*
+ * Runs body(x_begin, x_end, y_begin, y_end) over a width by height
+ * domain split into tile_w by tile_h tiles, as one bulk launch with a
+ * task per tile, returning once every tile is complete.  Load balancing
+ * comes from the task system handing out tiles dynamically; `order`
+ * decides which tiles are claimed close together in time.
+ */
+template <typename Body>
+void parallel_for_2d(ITaskSystem* t, int width, int height, int tile_w, int tile_h,
+                     const Body& body, TileOrder order = TILE_ORDER_ROW_MAJOR) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    ParallelFor2DRunnable<Body> runnable(width, height, std::max(1, tile_w),
+                                         std::max(1, tile_h), order, body);
+    t->run(&runnable, runnable.numTiles());
+}
+
+/*
+ * Asynchronous form of parallel_for_2d(), owned and freed by the
+ * launch like parallel_for_async().
+ */
+template <typename Body>
+TaskID parallel_for_2d_async(ITaskSystem* t, int width, int height, int tile_w, int tile_h,
+                             const Body& body, const std::vector<TaskID>& deps,
+                             TileOrder order = TILE_ORDER_ROW_MAJOR) {
+    ParallelFor2DRunnable<Body>* runnable =
+        new ParallelFor2DRunnable<Body>(std::max(0, width), std::max(0, height),
+                                        std::max(1, tile_w), std::max(1, tile_h), order, body);
+    TaskID task_id = t->runAsyncWithDeps(runnable, std::max(1, runnable->numTiles()), deps);
+    t->then(task_id, [runnable]{ delete runnable; });
+    return task_id;
+}
+
+#endif
@@ -1,9 +1,20 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <math.h>
 #include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
+#include "ppm.h"
+#include "parallel.h"
+#include "CycleTimer.h"
 
+// rows per chunk are chosen so a chunk is at least this many bytes
+#define PPM_MIN_CHUNK_BYTES (64 * 1024)
 
 void
 writePPMImage(int* data, int width, int height, const char *filename, int maxIterations)
@@ -33,3 +44,108 @@ writePPMImage(int* data, int width, int height, const char *filename, int maxIte
     fclose(fp);
     printf("Wrote image file %s\n", filename);
 }
+
+/*
+ * Gray level of every clamped count in [0, maxIterations], computed
+ * with exactly the expression writePPMImage() uses per pixel.
+ */
+static std::vector<unsigned char>
+toneMapTable(int maxIterations)
+{
+    std::vector<unsigned char> table(std::max(0, maxIterations) + 1);
+    for (size_t count = 0; count < table.size(); count++) {
+        float mapped = pow(static_cast<float>(count) / 256.f, .5f);
+        table[count] = static_cast<unsigned char>(255.f * mapped);
+    }
+    return table;
+}
+
+// writes all of buf, retrying after short writes and interrupts
+static bool
+writeAll(int fd, const char *buf, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(fd, buf, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buf += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool
+writePPMImageParallel(ITaskSystem* t, const int* data, int width, int height,
+                      const char *filename, int maxIterations,
+                      PPMWriteMode mode, PPMWriteStats* stats)
+{
+    double start_time = CycleTimer::currentSeconds();
+
+    char header[64];
+    int header_size = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    size_t row_bytes = 3 * static_cast<size_t>(width);
+    size_t size = header_size + row_bytes * height;
+    std::vector<unsigned char> table = toneMapTable(maxIterations);
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+
+    char *buf;
+    std::vector<char> buffer;
+    if (mode == PPM_WRITE_MMAP) {
+        void *map = MAP_FAILED;
+        if (ftruncate(fd, size) == 0) {
+            map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "Error: cannot map %s: %s\n", filename, strerror(errno));
+            close(fd);
+            return false;
+        }
+        buf = static_cast<char*>(map);
+    } else {
+        buffer.resize(size);
+        buf = buffer.data();
+    }
+
+    memcpy(buf, header, header_size);
+    unsigned char *pixels = reinterpret_cast<unsigned char*>(buf + header_size);
+    const unsigned char *lut = table.data();
+    int max_count = maxIterations;
+    auto fill_row = [=](int j) {
+        const int *in = data + static_cast<size_t>(j) * width;
+        unsigned char *out = pixels + j * row_bytes;
+        for (int i = 0; i < width; i++) {
+            unsigned char gray = lut[std::max(0, std::min(max_count, in[i]))];
+            out[3 * i] = gray;
+            out[3 * i + 1] = gray;
+            out[3 * i + 2] = gray;
+        }
+    };
+    int rows_per_chunk = std::max<size_t>(1, PPM_MIN_CHUNK_BYTES / std::max<size_t>(1, row_bytes));
+    parallel_for(t, height, fill_row,
+                 std::max(1, std::min(PARALLEL_DEFAULT_NUM_CHUNKS, height / rows_per_chunk)));
+
+    bool ok;
+    if (mode == PPM_WRITE_MMAP) {
+        ok = munmap(buf, size) == 0;
+    } else {
+        ok = writeAll(fd, buf, size);
+    }
+    ok = close(fd) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: cannot write %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+
+    if (stats) {
+        stats->bytes = size;
+        stats->seconds = CycleTimer::currentSeconds() - start_time;
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef _PPM_H
+#define _PPM_H
+
+#include "itasksys.h"
+
+/*
+ * Writers for Mandelbrot iteration counts as binary (P6) PPM images.
+ * Each count is clamped to maxIterations and mapped to a gray level
+ * by (count / 256)^0.5.
+ */
+
+// one pixel at a time through stdio; prints a line when done
+void writePPMImage(int* data, int width, int height, const char *filename, int maxIterations);
+
+enum PPMWriteMode {
+    // fill a buffer in memory, then write() it to the file
+    PPM_WRITE_BUFFERED,
+    // size the file and fill it in place through mmap()
+    PPM_WRITE_MMAP,
+};
+
+typedef struct {
+    long long bytes;
+    double seconds;
+} PPMWriteStats;
+
+/*
+ * Writes the same image as writePPMImage(), tone mapping through a
+ * lookup table and filling the pixels in parallel row chunks on `t`.
+ * Returns false, after printing why, if the file cannot be written.
+ * If `stats` is given it receives the file size and the time taken,
+ * from opening the file to closing it.
+ */
+bool writePPMImageParallel(ITaskSystem* t, const int* data, int width, int height,
+                           const char *filename, int maxIterations,
+                           PPMWriteMode mode = PPM_WRITE_BUFFERED,
+                           PPMWriteStats* stats = NULL);
+
+#endif
@@ -4,9 +4,61 @@
 
 IRunnable::~IRunnable() {}
 
+void IRunnable::runTaskRange(int begin, int end, int num_total_tasks) {
+    for (int i = begin; i < end; i++) {
+        runTask(i, num_total_tasks);
+    }
+}
+
 ITaskSystem::ITaskSystem(int num_threads) {}
 ITaskSystem::~ITaskSystem() {}
 
+void ITaskSystem::then(TaskID task_id, std::function<void()> callback) {
+    sync();
+    callback();
+}
+
+void ITaskSystem::setStatistics(bool enabled) {}
+
+TaskSystemStats ITaskSystem::getStats() {
+    TaskSystemStats stats = {};
+    return stats;
+}
+
+void ITaskSystem::setProfiling(bool enabled) {}
+
+TaskGraphProfile ITaskSystem::getProfile() {
+    TaskGraphProfile profile = {};
+    return profile;
+}
+
+TaskSystemLatencies ITaskSystem::getLatencies() {
+    TaskSystemLatencies latencies = {};
+    return latencies;
+}
+
+void ITaskSystem::setHardwareCounters(bool enabled) {}
+
+HardwareCounters ITaskSystem::getHardwareCounters() {
+    HardwareCounters counters = { -1, -1, -1, -1, false };
+    return counters;
+}
+
+HardwareCounters ITaskSystem::getLaunchHardwareCounters(TaskID task_id) {
+    return getHardwareCounters();
+}
+
+void ITaskSystem::setDependencyReduction(bool enabled) {}
+
+// Engines hand out tasks in chunks of a few per thread, so that late
+// claims can even out imbalance while keeping one runTaskRange() call
+// per chunk.
+#define CHUNKS_PER_THREAD 4
+
+static int chunkSize(int num_total_tasks, int num_threads) {
+    return std::max(1, num_total_tasks / (num_threads * CHUNKS_PER_THREAD));
+}
+
 /*
  * ================================================================
  * Serial task system implementation
@@ -23,9 +75,7 @@ TaskSystemSerial::TaskSystemSerial(int num_threads): ITaskSystem(num_threads) {
 TaskSystemSerial::~TaskSystemSerial() {}
 
 void TaskSystemSerial::run(IRunnable* runnable, int num_total_tasks) {
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
+    runnable->runTaskRange(0, num_total_tasks, num_total_tasks);
 }
 
 TaskID TaskSystemSerial::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
@@ -70,10 +120,15 @@ void TaskSystemParallelSpawn::run(IRunnable* runnable, int num_total_tasks) {
     // tasks sequentially on the calling thread.
     //
     std::vector<std::thread> threads;
+    std::atomic<int> next_task(0);
+    int chunk = chunkSize(num_total_tasks, num_threads);
     for (int i = 0; i < num_threads; i++) {
-	    threads.push_back(std::thread([=]{
-				    for (int j = i; j < num_total_tasks; j += num_threads) {
-				    runnable->runTask(j, num_total_tasks);
+	    threads.push_back(std::thread([=, &next_task]{
+				    while (true) {
+				    int begin = next_task.fetch_add(chunk);
+				    if (begin >= num_total_tasks) break;
+				    int end = std::min(begin + chunk, num_total_tasks);
+				    runnable->runTaskRange(begin, end, num_total_tasks);
 				    }
 				    }));
     }
@@ -119,12 +174,13 @@ TaskSystemParallelThreadPoolSpinning::TaskSystemParallelThreadPoolSpinning(int n
                     while (this->started) {
                     this->m->lock();
                     while (this->works > 0) {
-                    int work = this->works - 1;
-                    this->works--;
+                    int end = this->works;
+                    int begin = std::max(0, end - chunkSize(this->total, num_threads));
+                    this->works = begin;
                     this->m->unlock();
-                    this->runnable->runTask(work, this->total);
+                    this->runnable->runTaskRange(begin, end, this->total);
                     this->m->lock();
-                    this->done++;
+                    this->done += end - begin;
                     }
                     this->m->unlock();
                     }
@@ -195,6 +251,7 @@ TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(int n
     this->total = 0;
     this->num_threads = num_threads;
     this->done = 0;
+    this->next_task = 0;
     
     for (int i = 0; i < num_threads; i++) {
         threads.push_back(std::thread([=](){
@@ -212,8 +269,11 @@ TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(int n
 			total = this->total;
 			runnable = this->runnable;
                         }
-			for (int j = i; j < total; j += num_threads) {
-			runnable->runTask(j, total);
+			int chunk = chunkSize(total, num_threads);
+			while (true) {
+			int begin = next_task.fetch_add(chunk);
+			if (begin >= total) break;
+			runnable->runTaskRange(begin, std::min(begin + chunk, total), total);
 			}
                     }
                     }));
@@ -265,6 +325,7 @@ void TaskSystemParallelThreadPoolSleeping::run(IRunnable* runnable, int num_tota
     this->total = num_total_tasks;
     this->runnable = runnable;
     this->done = 0;
+    this->next_task = 0;
     }
     
     cond_worker.notify_all();
@@ -6,6 +6,7 @@
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
+#include <algorithm>
 
 /*
  * TaskSystemSerial: This class is the student's implementation of a
@@ -84,6 +85,7 @@ class TaskSystemParallelThreadPoolSleeping: public ITaskSystem {
         int works;
         int total;
         std::atomic<bool> started;
+        std::atomic<int> next_task;
         IRunnable *runnable;
     public:
         TaskSystemParallelThreadPoolSleeping(int num_threads);
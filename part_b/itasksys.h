@@ -1,9 +1,109 @@
 #ifndef _ITASKSYS_H
 #define _ITASKSYS_H
 #include <vector>
+#include <functional>
 
 typedef int TaskID;
 
+/*
+ * Counters kept by one worker thread of a task system.  Times are in
+ * seconds.
+ */
+typedef struct {
+    long long tasks_executed;
+    long long chunks_claimed;
+    // launches this worker took part in
+    long long launches;
+    // times the worker found its next launch still waiting on
+    // dependencies and had to poll again
+    long long dep_polls_failed;
+    // times the worker blocked for lack of work, and times it was
+    // woken up while blocked (a wake-up may find nothing to do)
+    long long parks;
+    long long wakeups;
+    // inside runTaskRange(), and blocked or polling for work
+    double busy_time;
+    double idle_time;
+} WorkerStats;
+
+/*
+ * Scheduler statistics reported by ITaskSystem::getStats().  Counters
+ * accumulate over the lifetime of the task system.
+ */
+typedef struct {
+    // then() callbacks executed, and the time spent inside them
+    long long continuations_run;
+    double continuation_time;
+    // dependencies passed to runAsyncWithDeps(), and those left to
+    // wait on after dropping completed, duplicate and implied ones
+    long long dependencies_listed;
+    long long dependencies_tracked;
+    // run() launches small enough to execute on the calling thread
+    long long launches_inlined;
+    // one entry per worker thread; empty if the system keeps none
+    std::vector<WorkerStats> workers;
+} TaskSystemStats;
+
+/*
+ * Work/span profile of the launches completed since profiling was
+ * enabled, reported by ITaskSystem::getProfile().  Times are in
+ * seconds.  Average parallelism is work / span, and a greedy scheduler
+ * on P threads finishes within work / P + span.
+ */
+typedef struct {
+    long long launches;
+    // time spent running tasks, summed over all launches
+    double work;
+    // longest chain of dependent launches, each launch weighted by its
+    // longest task (its duration on unlimited threads).  Tasks are timed
+    // in chunks, so a task counts as its chunk's time over its length.
+    // A launch submitted after a sync() or run() returned depends on
+    // every launch submitted before that.
+    double span;
+    // first submission to last completion
+    double makespan;
+} TaskGraphProfile;
+
+/*
+ * Distribution of one scheduling latency, in seconds.
+ */
+typedef struct {
+    long long count;
+    double p50, p99, p999, max;
+} LatencySummary;
+
+/*
+ * Scheduling latencies recorded while profiling, reported by
+ * ITaskSystem::getLatencies().
+ */
+typedef struct {
+    // a launch being submitted to its first task starting
+    LatencySummary submit_to_start;
+    // the last dependency of a launch completing to a worker finding
+    // the launch ready; only launches that had to wait are counted
+    LatencySummary dependency_release;
+    // a parked worker being signalled to it running again
+    LatencySummary wakeup;
+} TaskSystemLatencies;
+
+/*
+ * Hardware event counts reported by ITaskSystem::getHardwareCounters(),
+ * summed over the worker threads.  A count is -1 when the event could
+ * not be measured (unsupported CPU or kernel, or insufficient
+ * permissions).
+ */
+typedef struct {
+    long long cycles;
+    long long instructions;
+    // last-level cache misses
+    long long llc_misses;
+    long long branch_misses;
+    // set when the kernel multiplexed the counters with other events,
+    // so that some counts are estimates scaled up from the time they
+    // were actually counting
+    bool scaled;
+} HardwareCounters;
+
 class IRunnable {
     public:
         virtual ~IRunnable();
@@ -18,6 +118,16 @@ class IRunnable {
              task launch.
          */
         virtual void runTask(int task_id, int num_total_tasks) = 0;
+
+        /*
+          Executes the contiguous block of tasks [begin, end) of a bulk
+          task launch of num_total_tasks.  Task systems call this once
+          per chunk of tasks they claim.  The default implementation
+          calls runTask() for each task in order; runnables can
+          override it to hoist per-task setup or vectorize across the
+          block.
+         */
+        virtual void runTaskRange(int begin, int end, int num_total_tasks);
 };
 
 class ITaskSystem {
@@ -66,5 +176,80 @@ class ITaskSystem {
           runXXX calls are done.
          */
         virtual void sync() = 0;
+
+        /*
+          Registers `callback` to run once every task in the bulk task
+          launch `task_id` has completed.  The callback runs on the
+          worker that finished the last task of the launch, before any
+          launch depending on `task_id` may start and before sync()
+          returns.  If the launch has already completed, the callback
+          runs immediately on the calling thread.
+
+          Callbacks should be short (logging, releasing buffers,
+          signalling a waiter) and must not call sync().  The default
+          implementation calls sync() and then runs the callback.
+         */
+        virtual void then(TaskID task_id, std::function<void()> callback);
+
+        /*
+          Starts (or stops) collecting the per-worker statistics
+          reported by getStats() for work done from now on.  Off by
+          default since it times every chunk of tasks.  The default
+          implementation collects nothing.
+         */
+        virtual void setStatistics(bool enabled);
+
+        /*
+          Returns the scheduler statistics collected so far.  Only
+          meaningful after sync(); implementations that collect no
+          statistics return all zeros.
+         */
+        virtual TaskSystemStats getStats();
+
+        /*
+          Starts (or stops) recording the execution time and
+          dependencies of each bulk task launch submitted from now on,
+          along with scheduling latencies.  Off by default since it adds
+          timing to every chunk of tasks.  The default implementation
+          records nothing.
+         */
+        virtual void setProfiling(bool enabled);
+
+        /*
+          Returns the work/span profile of the launches recorded since
+          profiling was enabled.  Only meaningful after sync();
+          implementations that do not profile return all zeros.
+         */
+        virtual TaskGraphProfile getProfile();
+
+        /*
+          Returns the scheduling latencies recorded since profiling was
+          enabled.  Implementations that do not profile return all
+          zeros.
+         */
+        virtual TaskSystemLatencies getLatencies();
+
+        /*
+          Starts (or stops) counting hardware events on the worker
+          threads for each bulk task launch executed from now on.  Off
+          by default.  The default implementation counts nothing.
+         */
+        virtual void setHardwareCounters(bool enabled);
+
+        /*
+          Returns the hardware events counted so far, over all launches
+          or for the launch `task_id` only.  Only meaningful after
+          sync(); counts that were not measured are -1.
+         */
+        virtual HardwareCounters getHardwareCounters();
+        virtual HardwareCounters getLaunchHardwareCounters(TaskID task_id);
+
+        /*
+          Starts (or stops) dropping dependencies of newly submitted
+          launches that another of their dependencies already waits
+          for, so fewer edges have to be checked.  Off by default.  The
+          default implementation keeps every dependency.
+         */
+        virtual void setDependencyReduction(bool enabled);
 };
 #endif
@@ -0,0 +1,153 @@
+#ifndef _PERFCOUNTERS_H
+#define _PERFCOUNTERS_H
+
+/*
+ * Hardware performance counters of the calling thread, read through
+ * Linux perf_event_open().  The four counters form one group so that a
+ * single read() returns them together.  Counters the kernel or the CPU
+ * does not support (including everything when perf_event_paranoid or
+ * a container forbids it, and on other operating systems) read as -1.
+ *
+ * When more events are open than the PMU has counters, the kernel
+ * multiplexes the group and it only counts part of the time.  Each
+ * sample carries the time the group was enabled and the time it was
+ * actually counting, and delta() scales counts up by their ratio.
+ */
+
+#include <string.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define PERF_NUM_COUNTERS 4
+
+// order of the values returned by PerfCounterGroup::read()
+enum PerfCounter { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_LLC_MISSES, PERF_BRANCH_MISSES };
+
+// running totals since PerfCounterGroup::open()
+typedef struct {
+	long long values[PERF_NUM_COUNTERS];
+	// nanoseconds the group was enabled, and actually on the PMU
+	unsigned long long time_enabled, time_running;
+} PerfSample;
+
+class PerfCounterGroup {
+	private:
+		int fds[PERF_NUM_COUNTERS];
+		// position of each counter in the group read, or -1
+		int slot[PERF_NUM_COUNTERS];
+		int num_open;
+
+#ifdef __linux__
+		static int open_counter(unsigned long long config, int group_fd) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = config;
+			attr.disabled = group_fd == -1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+					   PERF_FORMAT_TOTAL_TIME_RUNNING;
+			return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+		}
+#endif
+
+	public:
+		PerfCounterGroup() : num_open(0) {
+			for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+				fds[i] = -1;
+				slot[i] = -1;
+			}
+		}
+		~PerfCounterGroup() {
+#ifdef __linux__
+			for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+				if (fds[i] != -1) close(fds[i]);
+			}
+#endif
+		}
+
+		// starts counting for the calling thread; false if not even the
+		// cycle counter could be opened
+		bool open() {
+#ifdef __linux__
+			// PERF_COUNT_HW_CACHE_MISSES counts last-level cache misses
+			static const unsigned long long configs[PERF_NUM_COUNTERS] = {
+				PERF_COUNT_HW_CPU_CYCLES,
+				PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_MISSES,
+				PERF_COUNT_HW_BRANCH_MISSES,
+			};
+			for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+				fds[i] = open_counter(configs[i], i == 0 ? -1 : fds[0]);
+				if (fds[i] == -1) {
+					if (i == 0) return false;
+					continue;
+				}
+				slot[i] = num_open++;
+			}
+			ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		bool is_open() {
+			return num_open > 0;
+		}
+
+		// false if the group is not open
+		bool read(PerfSample &sample) {
+			for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+				sample.values[i] = -1;
+			}
+			sample.time_enabled = sample.time_running = 0;
+#ifdef __linux__
+			if (num_open == 0) return false;
+			// { nr, time_enabled, time_running, value[nr] }
+			unsigned long long buf[3 + PERF_NUM_COUNTERS];
+			if (::read(fds[0], buf, sizeof(buf)) < (ssize_t) (3 * sizeof(unsigned long long))) {
+				return false;
+			}
+			sample.time_enabled = buf[1];
+			sample.time_running = buf[2];
+			for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+				if (slot[i] != -1) sample.values[i] = buf[3 + slot[i]];
+			}
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		// events counted between two samples, scaled by the share of the
+		// interval the group was on the PMU; -1 for counters that are
+		// not open or that never got on the PMU.  Returns true if the
+		// counts had to be scaled.
+		static bool delta(const PerfSample &before, const PerfSample &after,
+				  long long events[PERF_NUM_COUNTERS]) {
+			unsigned long long enabled = after.time_enabled - before.time_enabled;
+			unsigned long long running = after.time_running - before.time_running;
+			for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+				if (before.values[i] < 0 || after.values[i] < 0 ||
+				    (running == 0 && enabled > 0)) {
+					events[i] = -1;
+					continue;
+				}
+				events[i] = after.values[i] - before.values[i];
+				if (running < enabled) {
+					events[i] = (long long)((double)events[i] * enabled / running);
+				}
+			}
+			return running < enabled;
+		}
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef _TASKCORO_H
+#define _TASKCORO_H
+
+/*
+ * C++20 coroutine adaptor for ITaskSystem.  Requires -std=c++20; see
+ * the runtasks_coro target in the Makefile.
+ *
+ *     AwaitableTaskSystem system(t);
+ *     TaskID id = co_await system.launch(runnable, num_total_tasks, deps);
+ *
+ * launch() submits the bulk task launch immediately through
+ * runAsyncWithDeps(), so its TaskID (launch(...).id()) can be used as a
+ * dependency of later launches before it is awaited.  co_await suspends
+ * the coroutine until the launch completes and evaluates to its TaskID.
+ *
+ * A launch that has already completed when it is awaited does not
+ * suspend the coroutine at all.  Otherwise, without an executor the
+ * coroutine resumes on the worker that finished the launch's last task
+ * (see ITaskSystem::then()).  It then runs until its next suspension
+ * point while that worker holds up dependents of the launch and
+ * sync(), so it must not call sync() and should suspend again quickly.
+ * Longer-running coroutines should supply an executor, which is handed
+ * the coroutine to resume wherever it likes.
+ *
+ * Awaiting needs no extra threads and no heap allocation beyond the
+ * coroutine frame: the awaitable lives in the frame and the callback
+ * registered with then() captures only a pointer to it.
+ */
+
+#include <atomic>
+#include <coroutine>
+#include <functional>
+#include <vector>
+#include "itasksys.h"
+
+class AwaitableTaskSystem {
+    public:
+        typedef std::function<void(std::coroutine_handle<>)> Executor;
+
+        class LaunchAwaitable {
+            private:
+                ITaskSystem *system_;
+                const Executor *executor_;
+                TaskID id_;
+                std::coroutine_handle<> handle_;
+                // set by whichever of await_suspend() and the then()
+                // callback gets there first; the other one resumes
+                std::atomic<bool> arrived_;
+
+                void resume() {
+                    if (*executor_) {
+                        (*executor_)(handle_);
+                    } else {
+                        handle_.resume();
+                    }
+                }
+
+            public:
+                LaunchAwaitable(ITaskSystem *system, const Executor *executor, TaskID id)
+                  : system_(system), executor_(executor), id_(id), arrived_(false) {}
+                LaunchAwaitable(const LaunchAwaitable &other)
+                  : system_(other.system_), executor_(other.executor_), id_(other.id_),
+                    arrived_(false) {}
+
+                TaskID id() const { return id_; }
+
+                bool await_ready() const noexcept { return false; }
+
+                // then() runs the callback right away when the launch has
+                // already completed.  Resuming from there would nest one
+                // more frame per co_await, so in that case the callback
+                // only records its arrival and the coroutine continues
+                // by returning false.  Once the callback may resume the
+                // coroutine (and destroy it), nothing touches `this`.
+                bool await_suspend(std::coroutine_handle<> handle) {
+                    handle_ = handle;
+                    LaunchAwaitable *self = this;
+                    system_->then(id_, [self]{
+                        if (self->arrived_.exchange(true)) {
+                            self->resume();
+                        }
+                    });
+                    return !arrived_.exchange(true);
+                }
+
+                TaskID await_resume() const noexcept { return id_; }
+        };
+
+        AwaitableTaskSystem(ITaskSystem *system) : system_(system) {}
+        AwaitableTaskSystem(ITaskSystem *system, Executor executor)
+          : system_(system), executor_(executor) {}
+
+        LaunchAwaitable launch(IRunnable *runnable, int num_total_tasks,
+                               const std::vector<TaskID> &deps = std::vector<TaskID>()) {
+            TaskID id = system_->runAsyncWithDeps(runnable, num_total_tasks, deps);
+            return LaunchAwaitable(system_, &executor_, id);
+        }
+
+        ITaskSystem *system() { return system_; }
+
+    private:
+        ITaskSystem *system_;
+        Executor executor_;
+};
+
+#endif
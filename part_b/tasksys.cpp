@@ -4,9 +4,74 @@
 
 IRunnable::~IRunnable() {}
 
+void IRunnable::runTaskRange(int begin, int end, int num_total_tasks) {
+    for (int i = begin; i < end; i++) {
+        runTask(i, num_total_tasks);
+    }
+}
+
 ITaskSystem::ITaskSystem(int num_threads) {}
 ITaskSystem::~ITaskSystem() {}
 
+void ITaskSystem::then(TaskID task_id, std::function<void()> callback) {
+    sync();
+    callback();
+}
+
+void ITaskSystem::setStatistics(bool enabled) {}
+
+TaskSystemStats ITaskSystem::getStats() {
+    TaskSystemStats stats = {};
+    return stats;
+}
+
+void ITaskSystem::setProfiling(bool enabled) {}
+
+TaskGraphProfile ITaskSystem::getProfile() {
+    TaskGraphProfile profile = {};
+    return profile;
+}
+
+TaskSystemLatencies ITaskSystem::getLatencies() {
+    TaskSystemLatencies latencies = {};
+    return latencies;
+}
+
+void ITaskSystem::setHardwareCounters(bool enabled) {}
+
+HardwareCounters ITaskSystem::getHardwareCounters() {
+    HardwareCounters counters = { -1, -1, -1, -1, false };
+    return counters;
+}
+
+HardwareCounters ITaskSystem::getLaunchHardwareCounters(TaskID task_id) {
+    return getHardwareCounters();
+}
+
+void ITaskSystem::setDependencyReduction(bool enabled) {}
+
+// Engines hand out tasks in chunks of a few per thread, so that late
+// claims can even out imbalance while keeping one runTaskRange() call
+// per chunk.
+#define CHUNKS_PER_THREAD 4
+
+static int chunkSize(int num_total_tasks, int num_threads) {
+    return std::max(1, num_total_tasks / (num_threads * CHUNKS_PER_THREAD));
+}
+
+// run() executes a launch on the calling thread when its tasks are
+// expected to take less than this in total, about what waking the pool
+// and waiting for it costs.
+#define INLINE_RUN_MAX_SECONDS 5e-6
+#define INLINE_RUN_MAX_TASKS 64
+// a launch that runs on the pool is timed while its cost is unknown
+// and then once every this many runs, so that a cost that dropped is
+// noticed without timing every chunk
+#define RUN_COST_SAMPLE_PERIOD 16
+// learned costs are forgotten when there are more than this many, as
+// runnables are keyed by address and may long have been freed
+#define RUN_COST_MAX_ENTRIES 1024
+
 /*
  * ================================================================
  * Serial task system implementation
@@ -23,16 +88,12 @@ TaskSystemSerial::TaskSystemSerial(int num_threads): ITaskSystem(num_threads) {
 TaskSystemSerial::~TaskSystemSerial() {}
 
 void TaskSystemSerial::run(IRunnable* runnable, int num_total_tasks) {
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
+    runnable->runTaskRange(0, num_total_tasks, num_total_tasks);
 }
 
 TaskID TaskSystemSerial::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                           const std::vector<TaskID>& deps) {
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
+    runnable->runTaskRange(0, num_total_tasks, num_total_tasks);
 
     return 0;
 }
@@ -59,17 +120,13 @@ TaskSystemParallelSpawn::~TaskSystemParallelSpawn() {}
 
 void TaskSystemParallelSpawn::run(IRunnable* runnable, int num_total_tasks) {
     // NOTE: CS149 students are not expected to implement TaskSystemParallelSpawn in Part B.
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
+    runnable->runTaskRange(0, num_total_tasks, num_total_tasks);
 }
 
 TaskID TaskSystemParallelSpawn::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                                  const std::vector<TaskID>& deps) {
     // NOTE: CS149 students are not expected to implement TaskSystemParallelSpawn in Part B.
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
+    runnable->runTaskRange(0, num_total_tasks, num_total_tasks);
 
     return 0;
 }
@@ -97,17 +154,13 @@ TaskSystemParallelThreadPoolSpinning::~TaskSystemParallelThreadPoolSpinning() {}
 
 void TaskSystemParallelThreadPoolSpinning::run(IRunnable* runnable, int num_total_tasks) {
     // NOTE: CS149 students are not expected to implement TaskSystemParallelThreadPoolSpinning in Part B.
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
+    runnable->runTaskRange(0, num_total_tasks, num_total_tasks);
 }
 
 TaskID TaskSystemParallelThreadPoolSpinning::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                                               const std::vector<TaskID>& deps) {
     // NOTE: CS149 students are not expected to implement TaskSystemParallelThreadPoolSpinning in Part B.
-    for (int i = 0; i < num_total_tasks; i++) {
-        runnable->runTask(i, num_total_tasks);
-    }
+    runnable->runTaskRange(0, num_total_tasks, num_total_tasks);
 
     return 0;
 }
@@ -136,19 +189,73 @@ TaskSystemParallelThreadPoolSleeping::TaskSystemParallelThreadPoolSleeping(int n
     //
     this->num_threads = num_threads;
     this->task_list = new TaskList(num_threads);
-    this->count = 0;
+    this->inline_max_ticks = INLINE_RUN_MAX_SECONDS / CycleTimer::secondsPerTick();
+    this->launches_inlined = 0;
     for (int i = 0; i < num_threads; i++) {
        threads.push_back(std::thread([=]{
+			       WorkerCounters &c = task_list->worker_counters(i);
+			       // opened by the worker itself on first use
+			       PerfCounterGroup perf;
+			       bool perf_tried = false;
+			       PerfSample hw_before = {}, hw_after = {};
 			       while (!task_list->is_terminated()) {
 			       		task_list->notify_main();
 			       		task_list->wait(i);
 					if (task_list->is_terminated()) break;
-					Task t = task_list->front(i);
-					if (!task_list->is_ready(t.depends)) continue;
-					for (int j = i; j < t.num_total_tasks; j += num_threads) {
-						t.runnable->runTask(j, t.num_total_tasks);
+					bool collecting = task_list->is_collecting_stats();
+					CycleTimer::SysClock poll_start = collecting ? CycleTimer::currentTicks() : 0;
+					Task *t = task_list->front(i);
+					if (!t) break;
+					if (!task_list->is_ready(t)) {
+						if (collecting) {
+							bump(c.dep_polls_failed, 1LL);
+							bump(c.idle_ticks, CycleTimer::currentTicks() - poll_start);
+						}
+						// let the threads running the dependencies have the core
+						std::this_thread::yield();
+						continue;
+					}
+					TRACE_READY(task_list->tracer, i, t->id, t->state.traced_ready);
+					bool profiling = task_list->is_profiling();
+					if (profiling) task_list->profile_ready(t);
+					bool counting = task_list->is_counting_hardware();
+					if (counting && !perf_tried) {
+						perf_tried = true;
+						perf.open();
+					}
+					counting = counting && perf.read(hw_before);
+					// chunks are only timed when something records the time
+					bool timing = collecting || profiling || t->state.measure;
+#ifdef TASKSYS_TRACE
+					timing = true;
+#endif
+					int chunk = chunkSize(t->num_total_tasks, num_threads);
+					while (true) {
+						int begin = t->state.next_task.fetch_add(chunk);
+						if (begin >= t->num_total_tasks) break;
+						int end = std::min(begin + chunk, t->num_total_tasks);
+						CycleTimer::SysClock start = timing ? CycleTimer::currentTicks() : 0;
+						t->runnable->runTaskRange(begin, end, t->num_total_tasks);
+						if (timing) {
+							CycleTimer::SysClock stop = CycleTimer::currentTicks();
+							TRACE_CHUNK(task_list->tracer, i, t->id, begin, end, start, stop);
+							if (collecting) bump(c.busy_ticks, stop - start);
+							if (profiling) {
+								task_list->profile_chunk(&t->state, stop - start, end - begin);
+							} else if (t->state.measure) {
+								t->state.work_ticks += stop - start;
+							}
+						}
+						if (collecting) {
+							bump(c.chunks_claimed, 1LL);
+							bump(c.tasks_executed, (long long)(end - begin));
+						}
+					}
+					if (counting && perf.read(hw_after)) {
+						task_list->count_hardware(&t->state, hw_before, hw_after);
 					}
-					task_list->pop_front(i);
+					if (collecting) bump(c.launches, 1LL);
+					task_list->pop_front(i, &t->state);
 			       }
 			}));
     } 
@@ -166,6 +273,7 @@ TaskSystemParallelThreadPoolSleeping::~TaskSystemParallelThreadPoolSleeping() {
     for (int i = 0; i < num_threads; i++) {
 	    threads[i].join();
     }
+    TRACE_FLUSH(task_list);
     delete(task_list);
 }
 
@@ -178,8 +286,34 @@ void TaskSystemParallelThreadPoolSleeping::run(IRunnable* runnable, int num_tota
     // tasks sequentially on the calling thread.
     //
 
-    runAsyncWithDeps(runnable, num_total_tasks, std::vector<TaskID>());
+    if (run_costs.size() > RUN_COST_MAX_ENTRIES) {
+        run_costs.clear();
+    }
+    RunCost &cost = run_costs[RunKey(runnable, num_total_tasks)];
+    // inlining is only safe once every earlier launch has completed,
+    // and profiles and hardware counters should see every launch
+    bool small = num_total_tasks <= INLINE_RUN_MAX_TASKS && cost.known &&
+                 cost.ticks_per_task * num_total_tasks <= inline_max_ticks;
+    if (small && task_list->is_idle() && !task_list->is_profiling() &&
+        !task_list->is_counting_hardware()) {
+        CycleTimer::SysClock start = CycleTimer::currentTicks();
+        runnable->runTaskRange(0, num_total_tasks, num_total_tasks);
+        cost.learn((double)(CycleTimer::currentTicks() - start) / num_total_tasks);
+        launches_inlined++;
+        return;
+    }
+
+    // launches too large to ever run inline are never timed
+    bool measure = num_total_tasks <= INLINE_RUN_MAX_TASKS &&
+                   (!cost.known || ++cost.unmeasured >= RUN_COST_SAMPLE_PERIOD);
+    TaskID task_id = task_list->emplace_back(runnable, num_total_tasks,
+                                             std::vector<TaskID>(), measure);
+    task_list->notify_threads();
     sync();
+    long long work = measure ? task_list->launch_work(task_id) : -1;
+    if (work >= 0) {
+        cost.learn((double)work / num_total_tasks);
+    }
 }
 
 TaskID TaskSystemParallelThreadPoolSleeping::runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
@@ -189,16 +323,10 @@ TaskID TaskSystemParallelThreadPoolSleeping::runAsyncWithDeps(IRunnable* runnabl
     //
     // TODO: CS149 students will implement this method in Part B.
     //
-    int task_id = count++;
-
-    // TODO: if depends on done task?
-    Task t = {
-		    .runnable = runnable,
-		    .num_total_tasks = num_total_tasks,
-		    .id = task_id,
-		    .depends = deps
-		    };
-    task_list->emplace_back(t);
+    // ids are assigned under the list lock so launches may also be
+    // submitted from continuations running on worker threads; the
+    // record comes from the list's pool, so this does not allocate
+    TaskID task_id = task_list->emplace_back(runnable, num_total_tasks, deps);
     task_list->notify_threads();
 
     return task_id;
@@ -211,4 +339,56 @@ void TaskSystemParallelThreadPoolSleeping::sync() {
     //
 
     task_list->wait_threads_done();
+    TRACE_FLUSH(task_list);
+}
+
+void TaskSystemParallelThreadPoolSleeping::then(TaskID task_id, std::function<void()> callback) {
+    task_list->then(task_id, callback);
+}
+
+void TaskSystemParallelThreadPoolSleeping::setStatistics(bool enabled) {
+    task_list->set_statistics(enabled);
+}
+
+TaskSystemStats TaskSystemParallelThreadPoolSleeping::getStats() {
+    TaskSystemStats stats = {};
+    task_list->get_stats(stats);
+    stats.launches_inlined = launches_inlined;
+    return stats;
+}
+
+void TaskSystemParallelThreadPoolSleeping::setProfiling(bool enabled) {
+    task_list->set_profiling(enabled);
+}
+
+TaskGraphProfile TaskSystemParallelThreadPoolSleeping::getProfile() {
+    TaskGraphProfile profile = {};
+    task_list->get_profile(profile);
+    return profile;
+}
+
+TaskSystemLatencies TaskSystemParallelThreadPoolSleeping::getLatencies() {
+    TaskSystemLatencies latencies = {};
+    task_list->get_latencies(latencies);
+    return latencies;
+}
+
+void TaskSystemParallelThreadPoolSleeping::setHardwareCounters(bool enabled) {
+    task_list->set_hardware_counters(enabled);
+}
+
+HardwareCounters TaskSystemParallelThreadPoolSleeping::getHardwareCounters() {
+    HardwareCounters counters;
+    task_list->get_hardware_counters(counters, -1);
+    return counters;
+}
+
+HardwareCounters TaskSystemParallelThreadPoolSleeping::getLaunchHardwareCounters(TaskID task_id) {
+    HardwareCounters counters;
+    task_list->get_hardware_counters(counters, task_id);
+    return counters;
+}
+
+void TaskSystemParallelThreadPoolSleeping::setDependencyReduction(bool enabled) {
+    task_list->set_dependency_reduction(enabled);
 }
@@ -8,6 +8,16 @@
 #include <thread>
 #include <atomic>
 #include <algorithm>
+#include <functional>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <stdint.h>
+#include "CycleTimer.h"
+#include "cacheline.h"
+#include "tasktrace.h"
+#include "perfcounters.h"
+#include "histogram.h"
 
 /*
  * TaskSystemSerial: This class is the student's implementation of a
@@ -59,76 +69,439 @@ class TaskSystemParallelThreadPoolSpinning: public ITaskSystem {
         void sync();
 };
 
+// bookkeeping shared by every worker that processes a launch
+typedef struct LaunchState {
+	// next task of the launch to be claimed
+	std::atomic<int> next_task;
+	// number of threads that have finished their share of the launch
+	std::atomic<int> threads_finished;
+	// then() callbacks, guarded by TaskList::m1
+	std::function<void()> continuation;
+	// recorded only while profiling: total time, longest time per task
+	// of any chunk, submission and completion
+	std::atomic<unsigned long long> work_ticks;
+	std::atomic<unsigned long long> max_task_ticks;
+	CycleTimer::SysClock submit_ticks;
+	CycleTimer::SysClock finish_ticks;
+	// launches [0, synced) had completed in a sync() before this one
+	// was submitted; recorded only while profiling
+	size_t synced;
+	// set by the first worker to start the launch while profiling
+	std::atomic<bool> started;
+	// work_ticks is also recorded when not profiling, see RunCost
+	bool measure;
+	// hardware events counted while the launch ran, see PerfCounter
+	std::atomic<long long> hw_events[PERF_NUM_COUNTERS];
+	// set if any worker's counts for the launch had to be scaled
+	std::atomic<bool> hw_scaled;
+#ifdef TASKSYS_TRACE
+	// set by the first worker to find the launch ready
+	std::atomic<bool> traced_ready;
+#endif
+	// readies a pooled record for its next launch
+	void reset() {
+		next_task = 0;
+		threads_finished = 0;
+		continuation = nullptr;
+		work_ticks = 0;
+		max_task_ticks = 0;
+		submit_ticks = 0;
+		synced = 0;
+		finish_ticks = 0;
+		started = false;
+		measure = false;
+		for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+			hw_events[i] = 0;
+		}
+		hw_scaled = false;
+#ifdef TASKSYS_TRACE
+		traced_ready = false;
+#endif
+	}
+} LaunchState;
+
+// per-worker counters behind WorkerStats.  Each worker only writes its
+// own block, so relaxed updates suffice; blocks are cache-line aligned
+// so that workers do not false-share.
+typedef struct alignas(CACHE_LINE_SIZE) WorkerCounters {
+	std::atomic<long long> tasks_executed;
+	std::atomic<long long> chunks_claimed;
+	std::atomic<long long> launches;
+	std::atomic<long long> dep_polls_failed;
+	std::atomic<long long> parks;
+	std::atomic<long long> wakeups;
+	std::atomic<unsigned long long> busy_ticks;
+	std::atomic<unsigned long long> idle_ticks;
+} WorkerCounters;
+
+template <typename T>
+inline void bump(std::atomic<T> &counter, T delta) {
+	counter.store(counter.load(std::memory_order_relaxed) + delta,
+		      std::memory_order_relaxed);
+}
+
+// dependencies a Task record holds without touching the heap
+#define TASK_INLINE_DEPS 4
+// Task records TaskPool allocates at a time
+#define TASK_SLAB_SIZE 256
+// launches TaskList can track before its ring of records has to grow
+#define TASK_RING_INITIAL_SIZE 1024
+// longest dependency list setDependencyReduction() tries to shorten;
+// the check is quadratic in the list length
+#define TASK_REDUCE_MAX_DEPS 32
+
 typedef struct Task {
 	IRunnable *runnable;
 	int num_total_tasks;
 	TaskID id;
-	std::vector<TaskID> depends;
+	int num_deps;
+	TaskID inline_deps[TASK_INLINE_DEPS];
+	// only used past TASK_INLINE_DEPS; keeps its capacity when the
+	// record is reused
+	std::vector<TaskID> extra_deps;
+	LaunchState state;
+	// next record on TaskPool's free list
+	struct Task *next_free;
+	const TaskID *deps() const {
+		return num_deps > TASK_INLINE_DEPS ? extra_deps.data() : inline_deps;
+	}
+	TaskID *deps() {
+		return num_deps > TASK_INLINE_DEPS ? extra_deps.data() : inline_deps;
+	}
+	void set_deps(const std::vector<TaskID> &deps) {
+		num_deps = deps.size();
+		if (num_deps > TASK_INLINE_DEPS) {
+			extra_deps.assign(deps.begin(), deps.end());
+		} else {
+			std::copy(deps.begin(), deps.end(), inline_deps);
+		}
+	}
 } Task;
 
+// Task records are carved out of slabs that are never moved or freed
+// before the TaskList, so workers can hold a Task* while new launches
+// are submitted.  Retired records go back on a free list, which makes
+// submission allocation free once the pool has grown to the number of
+// launches in flight.  Guarded by TaskList::m1.
+class TaskPool {
+	private:
+		std::vector<Task*> slabs;
+		Task *free_list;
+	public:
+		TaskPool() : free_list(NULL) {}
+		~TaskPool() {
+			for (size_t i = 0; i < slabs.size(); i++) {
+				delete[] slabs[i];
+			}
+		}
+		Task *acquire() {
+			if (!free_list) {
+				Task *slab = new Task[TASK_SLAB_SIZE];
+				slabs.push_back(slab);
+				for (int i = TASK_SLAB_SIZE - 1; i >= 0; i--) {
+					slab[i].next_free = free_list;
+					free_list = &slab[i];
+				}
+			}
+			Task *task = free_list;
+			free_list = task->next_free;
+			return task;
+		}
+		void release(Task *task) {
+			task->next_free = free_list;
+			free_list = task;
+		}
+};
+
 // tasks added to list sequentially
 // assuming that: 
 // 1. all tasks added later depends only on the task previously added
 // 2. accesses to this list are serialized
 // TODO: if there's need to wait when task waiting & notify threads waiting for tasks to be done
+//
+// Launches [retired, tasks_end) are live and launch id is held by
+// ring[id & ring_mask].  Once every worker has moved past a launch its
+// record goes back to the pool, unless profiling or hardware counting
+// may still read it.
 class TaskList {
 	private:
-		std::vector<Task> tasks;
+		std::vector<Task*> ring;
+		size_t ring_mask;
+		size_t retired;
+		std::atomic<size_t> tasks_end;
+		TaskPool pool;
+		// hardware events of launches whose records were retired
+		long long retired_hw_events[PERF_NUM_COUNTERS];
+		bool retired_hw_scaled;
 		std::atomic<size_t>* threads_index;
 		std::mutex m1, m2;
 		std::condition_variable cond_empty, cond_main;
 		int num_threads;
 		bool terminated;
+		std::atomic<long long> continuations_run;
+		std::atomic<unsigned long long> continuation_ticks;
+		char *counters_buf;
+		WorkerCounters *counters;
+		std::atomic<bool> profiling;
+		std::atomic<bool> hw_counters;
+		// WorkerCounters are only updated while set
+		std::atomic<bool> collecting_stats;
+		std::atomic<bool> reduce_deps;
+		// see TaskSystemStats; written under m1
+		std::atomic<long long> deps_listed, deps_tracked;
+		// bit i set once PerfCounter i has been measured by any worker
+		std::atomic<int> hw_measured;
+		// first launch recorded by get_profile()
+		size_t profile_begin;
+		// launches submitted before the last sync() to return
+		std::atomic<size_t> synced_end;
+		// scheduling latencies in ticks, see TaskSystemLatencies
+		LatencyHistogram submit_latency, release_latency, wakeup_latency;
+		std::atomic<CycleTimer::SysClock> notify_ticks;
 		bool is_empty(int thread) {
-			return threads_index[thread] >= tasks.size();
+			return threads_index[thread] >= tasks_end;
+		}
+		Task *record(size_t taskID) {
+			return ring[taskID & ring_mask];
+		}
+		// called under m1 before each submission
+		void retire_done() {
+			if (profiling || hw_counters) return;
+			while (retired < tasks_end && is_done(retired)) {
+				Task *task = record(retired);
+				for (int j = 0; j < PERF_NUM_COUNTERS; j++) {
+					retired_hw_events[j] += task->state.hw_events[j];
+				}
+				retired_hw_scaled = retired_hw_scaled || task->state.hw_scaled;
+				pool.release(task);
+				retired++;
+			}
+		}
+		// Drops dependencies listed twice and, unless profiling (whose
+		// span should cover the whole graph), those that have already
+		// completed.  With reduce_deps it also drops those another
+		// dependency lists itself: only a later launch can depend on an
+		// earlier one, and the lists of live launches are pruned and
+		// sorted, so one binary search per pair finds them.
+		void prune_deps(Task *task) {
+			TaskID *deps = task->deps();
+			int n = task->num_deps;
+			std::sort(deps, deps + n);
+			n = std::unique(deps, deps + n) - deps;
+			if (!profiling) {
+				n = std::remove_if(deps, deps + n, [this](TaskID dep) {
+					return is_done(dep);
+				}) - deps;
+			}
+			if (reduce_deps && n > 1 && n <= TASK_REDUCE_MAX_DEPS) {
+				int kept = 0;
+				for (int i = 0; i < n; i++) {
+					bool implied = false;
+					for (int j = i + 1; j < n && !implied; j++) {
+						if ((size_t)deps[j] < retired) continue;
+						Task *later = record(deps[j]);
+						const TaskID *later_deps = later->deps();
+						implied = std::binary_search(later_deps,
+							later_deps + later->num_deps, deps[i]);
+					}
+					if (!implied) deps[kept++] = deps[i];
+				}
+				n = kept;
+			}
+			if (task->num_deps > TASK_INLINE_DEPS && n <= TASK_INLINE_DEPS) {
+				std::copy(deps, deps + n, task->inline_deps);
+			}
+			task->num_deps = n;
+		}
+		void grow_ring() {
+			std::vector<Task*> bigger(ring.size() * 2);
+			for (size_t id = retired; id < tasks_end; id++) {
+				bigger[id & (bigger.size() - 1)] = record(id);
+			}
+			ring.swap(bigger);
+			ring_mask = ring.size() - 1;
+		}
+		void run_continuation(std::function<void()> &cb) {
+			CycleTimer::SysClock start = CycleTimer::currentTicks();
+			cb();
+			continuation_ticks += CycleTimer::currentTicks() - start;
+			continuations_run++;
 		}
 	public:
+#ifdef TASKSYS_TRACE
+		TaskTracer *tracer;
+#endif
 		TaskList(int num_threads) {
 			this->num_threads = num_threads;
 			this->threads_index = new std::atomic<size_t>[num_threads];
 			for (int i = 0; i < num_threads; i++) {
 				threads_index[i] = 0;
 			}
+			ring.resize(TASK_RING_INITIAL_SIZE);
+			ring_mask = ring.size() - 1;
+			retired = 0;
+			tasks_end = 0;
+			for (int j = 0; j < PERF_NUM_COUNTERS; j++) {
+				retired_hw_events[j] = 0;
+			}
+			retired_hw_scaled = false;
 			terminated = false;
+			profiling = false;
+			hw_counters = false;
+			collecting_stats = false;
+			reduce_deps = false;
+			deps_listed = 0;
+			deps_tracked = 0;
+			hw_measured = 0;
+			profile_begin = 0;
+			synced_end = 0;
+			notify_ticks = 0;
+			continuations_run = 0;
+			continuation_ticks = 0;
+			// new[] does not honour alignas() before C++17
+			counters_buf = new char[sizeof(WorkerCounters) * num_threads + CACHE_LINE_SIZE];
+			uintptr_t misalign = reinterpret_cast<uintptr_t>(counters_buf) % CACHE_LINE_SIZE;
+			counters = reinterpret_cast<WorkerCounters*>(
+				counters_buf + (misalign ? CACHE_LINE_SIZE - misalign : 0));
+			for (int i = 0; i < num_threads; i++) {
+				new (&counters[i]) WorkerCounters();
+			}
+#ifdef TASKSYS_TRACE
+			tracer = new TaskTracer(num_threads);
+#endif
 		};
+#ifdef TASKSYS_TRACE
+		// appends new trace events to the trace file
+		void trace_flush() {
+			std::unique_lock<std::mutex> lck(m1);
+			tracer->flush();
+		}
+#endif
+		~TaskList() {
+			delete[] threads_index;
+			delete[] counters_buf;
+#ifdef TASKSYS_TRACE
+			delete tracer;
+#endif
+		}
 		void set_terminated() {
 			std::unique_lock<std::mutex> lck(m1);
 			terminated = true;
 		};
-		void push_back(Task& task) {
-			std::unique_lock<std::mutex> lck(m1);
-			tasks.push_back(task);
-		};
 		// notify when push_back will slow down threads locking process?
 		void notify_threads() {
+			if (profiling) notify_ticks = CycleTimer::currentTicks();
 			cond_empty.notify_all();
 		};
-		void emplace_back(Task& task) {
+		// assigns the launch its TaskID: its index in the list
+		TaskID emplace_back(IRunnable *runnable, int num_total_tasks,
+				    const std::vector<TaskID> &deps, bool measure = false) {
 			std::unique_lock<std::mutex> lck(m1);
-			tasks.emplace_back(task);
+			retire_done();
+			size_t id = tasks_end;
+			if (id - retired == ring.size()) grow_ring();
+			Task *task = pool.acquire();
+			task->runnable = runnable;
+			task->num_total_tasks = num_total_tasks;
+			task->id = id;
+			task->set_deps(deps);
+			prune_deps(task);
+			bump(deps_listed, (long long)deps.size());
+			bump(deps_tracked, (long long)task->num_deps);
+			task->state.reset();
+			task->state.measure = measure;
+			if (profiling) {
+				task->state.submit_ticks = CycleTimer::currentTicks();
+				task->state.synced = synced_end;
+			}
+			ring[id & ring_mask] = task;
+			tasks_end = id + 1;
+			TRACE_SUBMIT(tracer, task->id, task->num_total_tasks);
+			return task->id;
 		};
 		bool is_terminated() {
 			return terminated;
 		}
 		void wait(int thread) {
 			std::unique_lock<std::mutex> lck(m1);
-			while (!terminated && is_empty(thread)) cond_empty.wait(lck);
+			if (terminated || !is_empty(thread)) return;
+			WorkerCounters &c = counters[thread];
+			bool collecting = is_collecting_stats();
+			CycleTimer::SysClock start = CycleTimer::currentTicks();
+			if (collecting) bump(c.parks, 1LL);
+			while (!terminated && is_empty(thread)) {
+				cond_empty.wait(lck);
+				if (collecting) bump(c.wakeups, 1LL);
+				if (profiling && !is_empty(thread)) {
+					CycleTimer::SysClock signalled = notify_ticks;
+					CycleTimer::SysClock now = CycleTimer::currentTicks();
+					if (signalled > start && now > signalled) {
+						wakeup_latency.record(now - signalled);
+					}
+				}
+			}
+			if (collecting) bump(c.idle_ticks, CycleTimer::currentTicks() - start);
+		}
+		WorkerCounters &worker_counters(int thread) {
+			return counters[thread];
 		}
 		// must check empty first
-		bool is_ready(std::vector<TaskID> &deps) {
-			for (size_t i = 0; i < deps.size(); i++) {
+		bool is_ready(const Task *t) {
+			const TaskID *deps = t->deps();
+			for (int i = 0; i < t->num_deps; i++) {
 				if (!is_done(deps[i])) return false;
 			}
 			return true;
 		};
-		Task front(int thread) {
+		// the record stays valid until this thread pops the launch;
+		// NULL once terminated
+		Task *front(int thread) {
 			std::unique_lock<std::mutex> lck(m1);
 			while (!terminated && is_empty(thread)) cond_empty.wait(lck);
-			return tasks[threads_index[thread]];
+			if (is_empty(thread)) return NULL;
+			return record(threads_index[thread]);
 		};
-		void pop_front(int thread) {
-			threads_index[thread]++;
+		// the last thread to finish a launch runs its continuations
+		// before advancing, so dependents and sync() observe them
+		void pop_front(int thread, LaunchState *state) {
+			if (state->threads_finished.fetch_add(1) + 1 < num_threads) {
+				threads_index[thread]++;
+				return;
+			}
+			if (profiling) state->finish_ticks = CycleTimer::currentTicks();
+			while (true) {
+				std::function<void()> cb;
+				{
+					std::unique_lock<std::mutex> lck(m1);
+					if (!state->continuation) {
+						threads_index[thread]++;
+						return;
+					}
+					cb.swap(state->continuation);
+				}
+				run_continuation(cb);
+			}
 		};
+		void then(TaskID taskID, std::function<void()> &callback) {
+			{
+				std::unique_lock<std::mutex> lck(m1);
+				if (!is_done(taskID)) {
+					LaunchState *state = &record(taskID)->state;
+					if (state->continuation) {
+						std::function<void()> prev;
+						prev.swap(state->continuation);
+						state->continuation = [prev, callback]{
+							prev();
+							callback();
+						};
+					} else {
+						state->continuation = callback;
+					}
+					return;
+				}
+			}
+			run_continuation(callback);
+		}
 		bool is_done(size_t taskID) {
 			for (int i = 0; i < num_threads; i++) {
 				if (threads_index[i] <= taskID) {
@@ -137,20 +510,241 @@ class TaskList {
 			}
 			return true;
 		};
+		// every launch submitted so far has completed, including its
+		// continuations, so none can submit another
+		bool is_idle() {
+			size_t end = tasks_end;
+			return end == 0 || is_done(end - 1);
+		}
+		// ticks spent running the tasks of a launch submitted with
+		// measure set, or -1 once its record has been recycled
+		long long launch_work(TaskID taskID) {
+			std::unique_lock<std::mutex> lck(m1);
+			if ((size_t)taskID < retired) return -1;
+			return record(taskID)->state.work_ticks;
+		}
 		void notify_main() {
 			std::unique_lock<std::mutex> lck(m1);
-			if (tasks.empty()) return;
-			if (!is_done(tasks[tasks.size()-1].id)) return;
+			if (tasks_end == 0) return;
+			if (!is_done(tasks_end - 1)) return;
 			cond_main.notify_one();
 		}
 		void wait_threads_done() {
 			std::unique_lock<std::mutex> lck(m2);
-			if (tasks.empty()) return;
-			int taskID = tasks[tasks.size()-1].id;
-			cond_main.wait(lck, [=]{
+			if (tasks_end == 0) return;
+			size_t taskID = tasks_end - 1;
+			cond_main.wait(lck, [this, taskID]{
 						return is_done(taskID);
 					});
+			size_t synced = synced_end.load(std::memory_order_relaxed);
+			while (synced < taskID + 1 &&
+			       !synced_end.compare_exchange_weak(synced, taskID + 1)) {}
+		}
+		bool is_collecting_stats() {
+			return collecting_stats.load(std::memory_order_relaxed);
+		}
+		void set_statistics(bool enabled) {
+			collecting_stats = enabled;
+		}
+		bool is_profiling() {
+			return profiling.load(std::memory_order_relaxed);
+		}
+		void set_profiling(bool enabled) {
+			std::unique_lock<std::mutex> lck(m1);
+			if (enabled && !profiling) {
+				profile_begin = tasks_end;
+				submit_latency.reset();
+				release_latency.reset();
+				wakeup_latency.reset();
+			}
+			profiling = enabled;
+		}
+		// tasks are not timed one by one, so a chunk's time is split
+		// evenly between its tasks
+		void profile_chunk(LaunchState *state, unsigned long long ticks, int num_tasks) {
+			state->work_ticks += ticks;
+			unsigned long long per_task = ticks / num_tasks;
+			unsigned long long longest = state->max_task_ticks.load(std::memory_order_relaxed);
+			while (per_task > longest &&
+			       !state->max_task_ticks.compare_exchange_weak(longest, per_task)) {}
+		}
+		// called when a worker finds the launch ready; the first one
+		// records how long the launch waited to start
+		void profile_ready(Task *t) {
+			LaunchState *state = &t->state;
+			if (state->submit_ticks == 0 || state->started.exchange(true)) return;
+			CycleTimer::SysClock now = CycleTimer::currentTicks();
+			submit_latency.record(now - state->submit_ticks);
+			CycleTimer::SysClock released = 0;
+			{
+				std::unique_lock<std::mutex> lck(m1);
+				const TaskID *deps = t->deps();
+				for (int i = 0; i < t->num_deps; i++) {
+					// older records may have been recycled
+					if ((size_t)deps[i] < retired) continue;
+					released = std::max(released, record(deps[i])->state.finish_ticks);
+				}
+			}
+			if (released > state->submit_ticks && now > released) {
+				release_latency.record(now - released);
+			}
+		}
+		static void summarize(LatencyHistogram &histogram, LatencySummary &summary) {
+			double seconds_per_tick = CycleTimer::secondsPerTick();
+			summary.count = histogram.count();
+			summary.p50 = histogram.percentile(0.5) * seconds_per_tick;
+			summary.p99 = histogram.percentile(0.99) * seconds_per_tick;
+			summary.p999 = histogram.percentile(0.999) * seconds_per_tick;
+			summary.max = histogram.maximum() * seconds_per_tick;
+		}
+		void get_latencies(TaskSystemLatencies &latencies) {
+			summarize(submit_latency, latencies.submit_to_start);
+			summarize(release_latency, latencies.dependency_release);
+			summarize(wakeup_latency, latencies.wakeup);
 		}
+		// launches are listed in submission order and only depend on
+		// earlier ones, so one forward pass finds the longest chain.  A
+		// launch submitted after a sync() (as every launch after a run()
+		// is) also waits for all those submitted before it; longest[k]
+		// is the longest chain ending in the first k launches.
+		void get_profile(TaskGraphProfile &profile) {
+			std::unique_lock<std::mutex> lck(m1);
+			double seconds_per_tick = CycleTimer::secondsPerTick();
+			std::vector<unsigned long long> chain;
+			std::vector<unsigned long long> longest(1, 0);
+			unsigned long long work = 0, span = 0;
+			CycleTimer::SysClock first_submit = 0, last_finish = 0;
+			size_t begin = std::max(profile_begin, retired);
+			for (size_t i = begin; i < tasks_end && is_done(i); i++) {
+				Task *task = record(i);
+				LaunchState *state = &task->state;
+				const TaskID *deps = task->deps();
+				unsigned long long longest_dep = 0;
+				for (int j = 0; j < task->num_deps; j++) {
+					size_t dep = deps[j];
+					if (dep >= begin && dep < i) {
+						longest_dep = std::max(longest_dep, chain[dep - begin]);
+					}
+				}
+				if (state->synced > begin) {
+					longest_dep = std::max(longest_dep, longest[state->synced - begin]);
+				}
+				chain.push_back(longest_dep + state->max_task_ticks);
+				span = std::max(span, chain.back());
+				longest.push_back(span);
+				work += state->work_ticks;
+				if (i == begin) first_submit = state->submit_ticks;
+				last_finish = std::max(last_finish, state->finish_ticks);
+			}
+			profile.launches = chain.size();
+			profile.work = work * seconds_per_tick;
+			profile.span = span * seconds_per_tick;
+			profile.makespan = chain.empty() ? 0 : (last_finish - first_submit) * seconds_per_tick;
+		}
+		void set_dependency_reduction(bool enabled) {
+			reduce_deps = enabled;
+		}
+		bool is_counting_hardware() {
+			return hw_counters.load(std::memory_order_relaxed);
+		}
+		void set_hardware_counters(bool enabled) {
+			hw_counters = enabled;
+		}
+		// adds one worker's counter deltas over its share of a launch
+		void count_hardware(LaunchState *state, const PerfSample &before, const PerfSample &after) {
+			long long events[PERF_NUM_COUNTERS];
+			if (PerfCounterGroup::delta(before, after, events)) {
+				state->hw_scaled = true;
+			}
+			int measured = 0;
+			for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+				if (events[i] < 0) continue;
+				state->hw_events[i] += events[i];
+				measured |= 1 << i;
+			}
+			if ((hw_measured.load(std::memory_order_relaxed) & measured) != measured) {
+				hw_measured |= measured;
+			}
+		}
+		// all launches when taskID is negative.  A single launch whose
+		// record has been recycled reads as not measured.
+		void get_hardware_counters(HardwareCounters &counters, TaskID taskID) {
+			long long total[PERF_NUM_COUNTERS] = {};
+			int measured = hw_measured;
+			bool scaled = false;
+			{
+				std::unique_lock<std::mutex> lck(m1);
+				size_t begin = taskID < 0 ? retired : taskID;
+				size_t end = taskID < 0 ? (size_t)tasks_end : std::min((size_t)tasks_end, begin + 1);
+				if (taskID < 0) {
+					std::copy(retired_hw_events, retired_hw_events + PERF_NUM_COUNTERS, total);
+					scaled = retired_hw_scaled;
+				} else if (begin < retired) {
+					measured = 0;
+				}
+				for (size_t i = std::max(begin, retired); i < end; i++) {
+					for (int j = 0; j < PERF_NUM_COUNTERS; j++) {
+						total[j] += record(i)->state.hw_events[j];
+					}
+					scaled = scaled || record(i)->state.hw_scaled;
+				}
+			}
+			for (int j = 0; j < PERF_NUM_COUNTERS; j++) {
+				if (!(measured & (1 << j))) total[j] = -1;
+			}
+			counters.cycles = total[PERF_CYCLES];
+			counters.instructions = total[PERF_INSTRUCTIONS];
+			counters.llc_misses = total[PERF_LLC_MISSES];
+			counters.branch_misses = total[PERF_BRANCH_MISSES];
+			counters.scaled = scaled && measured != 0;
+		}
+		void get_stats(TaskSystemStats &stats) {
+			double seconds_per_tick = CycleTimer::secondsPerTick();
+			stats.continuations_run = continuations_run;
+			stats.continuation_time = continuation_ticks * seconds_per_tick;
+			stats.dependencies_listed = deps_listed;
+			stats.dependencies_tracked = deps_tracked;
+			stats.workers.resize(num_threads);
+			for (int i = 0; i < num_threads; i++) {
+				WorkerCounters &c = counters[i];
+				WorkerStats &w = stats.workers[i];
+				w.tasks_executed = c.tasks_executed;
+				w.chunks_claimed = c.chunks_claimed;
+				w.launches = c.launches;
+				w.dep_polls_failed = c.dep_polls_failed;
+				w.parks = c.parks;
+				w.wakeups = c.wakeups;
+				w.busy_time = c.busy_ticks * seconds_per_tick;
+				w.idle_time = c.idle_ticks * seconds_per_tick;
+			}
+		}
+};
+
+/*
+ * Running average of the time one task of a run() launch takes, used
+ * by run() to spot launches too small to be worth waking the pool for.
+ * Launches are told apart by runnable and task count, since instances
+ * of one type can do very different amounts of work per task.
+ */
+typedef struct RunCost {
+	double ticks_per_task;
+	bool known;
+	// pool launches since the cost was last measured
+	int unmeasured;
+	RunCost() : ticks_per_task(0), known(false), unmeasured(0) {}
+	void learn(double ticks) {
+		ticks_per_task = known ? 0.75 * ticks_per_task + 0.25 * ticks : ticks;
+		known = true;
+		unmeasured = 0;
+	}
+} RunCost;
+
+typedef std::pair<const IRunnable*, int> RunKey;
+
+struct RunKeyHash {
+	size_t operator()(const RunKey &key) const {
+		return std::hash<const IRunnable*>()(key.first) * 31 + key.second;
+	}
 };
 
 /*
@@ -164,7 +758,11 @@ class TaskSystemParallelThreadPoolSleeping: public ITaskSystem {
 	std::vector<std::thread> threads;
 	int num_threads;
 	TaskList *task_list;
-	int count;
+	// learned cost of the launches passed to run(); only touched by
+	// the thread calling run()
+	std::unordered_map<RunKey, RunCost, RunKeyHash> run_costs;
+	double inline_max_ticks;
+	long long launches_inlined;
     public:
         TaskSystemParallelThreadPoolSleeping(int num_threads);
         ~TaskSystemParallelThreadPoolSleeping();
@@ -173,6 +771,16 @@ class TaskSystemParallelThreadPoolSleeping: public ITaskSystem {
         TaskID runAsyncWithDeps(IRunnable* runnable, int num_total_tasks,
                                 const std::vector<TaskID>& deps);
         void sync();
+        void then(TaskID task_id, std::function<void()> callback);
+        void setStatistics(bool enabled);
+        TaskSystemStats getStats();
+        void setProfiling(bool enabled);
+        TaskGraphProfile getProfile();
+        TaskSystemLatencies getLatencies();
+        void setHardwareCounters(bool enabled);
+        HardwareCounters getHardwareCounters();
+        HardwareCounters getLaunchHardwareCounters(TaskID task_id);
+        void setDependencyReduction(bool enabled);
 };
 
 #endif
@@ -0,0 +1,255 @@
+#ifndef _TASKTRACE_H
+#define _TASKTRACE_H
+
+/*
+ * Execution tracer for the thread pool, enabled by building with
+ * -DTASKSYS_TRACE (make TRACE=1).  It records launch submission, the
+ * moment a worker first finds a launch ready, and the start and end of
+ * every chunk of tasks, and writes them as Chrome trace-event JSON
+ * (viewable in Perfetto or chrome://tracing).  The output file is
+ * $TASKSYS_TRACE_FILE, or tasksys_trace.json.  It is opened once per
+ * process and shared by every task system, each of which shows up as
+ * its own trace process; each sync() appends only the events recorded
+ * since the previous one, and the array is closed at exit.  Viewers
+ * accept the array unterminated, so the trace of a process that never
+ * exits normally still loads.
+ *
+ * Each worker writes only to its own ring buffer and submissions are
+ * recorded under the task list lock, so recording never takes a lock
+ * of its own.  A ring that fills up between two flushes overwrites its
+ * oldest events.
+ *
+ * Without TASKSYS_TRACE the TRACE_* macros expand to nothing and their
+ * arguments are not evaluated.
+ */
+
+#ifdef TASKSYS_TRACE
+#define TRACE_SUBMIT(tracer, task_id, num_total_tasks) \
+	(tracer)->submit(task_id, num_total_tasks)
+#define TRACE_READY(tracer, thread, task_id, traced_ready) \
+	(tracer)->ready(thread, task_id, traced_ready)
+#define TRACE_CHUNK(tracer, thread, task_id, begin, end, start, stop) \
+	(tracer)->chunk(thread, task_id, begin, end, start, stop)
+#define TRACE_FLUSH(task_list) (task_list)->trace_flush()
+#else
+#define TRACE_SUBMIT(tracer, task_id, num_total_tasks) ((void) 0)
+#define TRACE_READY(tracer, thread, task_id, traced_ready) ((void) 0)
+#define TRACE_CHUNK(tracer, thread, task_id, begin, end, start, stop) ((void) 0)
+#define TRACE_FLUSH(task_list) ((void) 0)
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include "CycleTimer.h"
+#include "itasksys.h"
+
+// events kept per thread; must be a power of two
+#define TRACE_RING_SIZE (1 << 14)
+
+/*
+ * The trace file, shared by every TaskTracer in the process.
+ */
+class TraceSink {
+	private:
+		FILE *fp;
+		bool opened;
+		int tracers;
+
+		TraceSink() : fp(NULL), opened(false), tracers(0) {
+			origin = CycleTimer::currentTicks();
+		}
+		~TraceSink() {
+			if (fp) {
+				fprintf(fp, "\n]\n");
+				fclose(fp);
+			}
+		}
+
+	public:
+		// guards the file and tracer numbering
+		std::mutex m;
+		// time zero of every trace in the process
+		CycleTimer::SysClock origin;
+
+		static TraceSink &get() {
+			static TraceSink sink;
+			return sink;
+		}
+		// caller must hold m
+		int next_tracer() {
+			return ++tracers;
+		}
+		// the file, opened on first use; NULL if it cannot be written.
+		// Caller must hold m.
+		FILE *file() {
+			if (!opened) {
+				opened = true;
+				const char *path = getenv("TASKSYS_TRACE_FILE");
+				if (!path) path = "tasksys_trace.json";
+				fp = fopen(path, "w");
+				if (!fp) {
+					fprintf(stderr, "TaskTracer: cannot write %s\n", path);
+				} else {
+					fprintf(fp, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+						"\"args\":{\"name\":\"tasksys\"}}");
+				}
+			}
+			return fp;
+		}
+};
+
+class TaskTracer {
+	private:
+		enum EventType { SUBMIT, READY, CHUNK };
+
+		typedef struct {
+			EventType type;
+			TaskID id;
+			int begin, end;
+			CycleTimer::SysClock start, stop;
+		} Event;
+
+		// single-producer ring; head counts every event ever written
+		typedef struct {
+			Event events[TRACE_RING_SIZE];
+			std::atomic<unsigned long long> head;
+		} Ring;
+
+		// rings [0, num_threads) belong to the workers, the last one
+		// to submitters
+		Ring *rings;
+		int num_threads;
+		// head of each ring as of the last flush
+		unsigned long long *flushed;
+		TraceSink &sink;
+		// trace process id of this task system
+		int pid;
+		bool named;
+
+		void record(int thread, EventType type, TaskID id, int begin, int end,
+			    CycleTimer::SysClock start, CycleTimer::SysClock stop) {
+			Ring &ring = rings[thread];
+			unsigned long long head = ring.head.load(std::memory_order_relaxed);
+			Event &e = ring.events[head & (TRACE_RING_SIZE - 1)];
+			e.type = type;
+			e.id = id;
+			e.begin = begin;
+			e.end = end;
+			e.start = start;
+			e.stop = stop;
+			ring.head.store(head + 1, std::memory_order_release);
+		}
+
+		double micros(CycleTimer::SysClock ticks) {
+			return (ticks - sink.origin) * CycleTimer::secondsPerTick() * 1e6;
+		}
+
+		void write_names(FILE *fp) {
+			fprintf(fp, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+				"\"args\":{\"name\":\"task system %d\"}}", pid, pid);
+			for (int i = 0; i <= num_threads; i++) {
+				if (i < num_threads) {
+					fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+						"\"args\":{\"name\":\"worker %d\"}}", pid, i, i);
+				} else {
+					fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+						"\"args\":{\"name\":\"submit\"}}", pid, i);
+				}
+			}
+		}
+
+		void write_event(FILE *fp, int thread, const Event &e) {
+			fprintf(fp, ",\n");
+			if (e.type == CHUNK) {
+				fprintf(fp, "{\"name\":\"launch %d\",\"cat\":\"chunk\",\"ph\":\"X\","
+					"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+					"\"args\":{\"launch\":%d,\"begin\":%d,\"end\":%d}}",
+					e.id, micros(e.start), micros(e.stop) - micros(e.start),
+					pid, thread, e.id, e.begin, e.end);
+			} else {
+				fprintf(fp, "{\"name\":\"%s %d\",\"cat\":\"launch\",\"ph\":\"i\",\"s\":\"t\","
+					"\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"launch\":%d",
+					e.type == SUBMIT ? "submit" : "ready", e.id,
+					micros(e.start), pid, thread, e.id);
+				if (e.type == SUBMIT) {
+					fprintf(fp, ",\"num_total_tasks\":%d", e.end);
+				}
+				fprintf(fp, "}}");
+			}
+		}
+
+	public:
+		TaskTracer(int num_threads) : sink(TraceSink::get()) {
+			this->num_threads = num_threads;
+			rings = new Ring[num_threads + 1];
+			flushed = new unsigned long long[num_threads + 1];
+			for (int i = 0; i <= num_threads; i++) {
+				rings[i].head = 0;
+				flushed[i] = 0;
+			}
+			std::lock_guard<std::mutex> lck(sink.m);
+			pid = sink.next_tracer();
+			named = false;
+		}
+		// workers must have stopped
+		~TaskTracer() {
+			flush();
+			delete[] flushed;
+			delete[] rings;
+		}
+
+		// caller must hold the task list lock
+		void submit(TaskID id, int num_total_tasks) {
+			CycleTimer::SysClock now = CycleTimer::currentTicks();
+			record(num_threads, SUBMIT, id, 0, num_total_tasks, now, now);
+		}
+		// records the first time any worker finds launch `id` ready
+		void ready(int thread, TaskID id, std::atomic<bool> &traced_ready) {
+			if (traced_ready.exchange(true)) return;
+			CycleTimer::SysClock now = CycleTimer::currentTicks();
+			record(thread, READY, id, 0, 0, now, now);
+		}
+		void chunk(int thread, TaskID id, int begin, int end,
+			   CycleTimer::SysClock start, CycleTimer::SysClock stop) {
+			record(thread, CHUNK, id, begin, end, start, stop);
+		}
+
+		// Appends the events recorded since the last flush.  The caller
+		// must hold the task list lock, so that the submit ring stays
+		// still; workers may still be running chunks (of launches that
+		// continuations submitted, say), so each worker event is copied
+		// and only written if the worker has not overwritten it since.
+		void flush() {
+			std::lock_guard<std::mutex> lck(sink.m);
+			FILE *fp = NULL;
+			for (int i = 0; i <= num_threads; i++) {
+				Ring &ring = rings[i];
+				unsigned long long head = ring.head.load(std::memory_order_acquire);
+				if (head == flushed[i]) continue;
+				if (!fp) {
+					fp = sink.file();
+					if (!fp) return;
+					if (!named) {
+						write_names(fp);
+						named = true;
+					}
+				}
+				unsigned long long tail = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+				if (tail < flushed[i]) tail = flushed[i];
+				for (unsigned long long j = tail; j < head; j++) {
+					Event e = ring.events[j & (TRACE_RING_SIZE - 1)];
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (ring.head.load(std::memory_order_relaxed) - j > TRACE_RING_SIZE) {
+						continue;
+					}
+					write_event(fp, i, e);
+				}
+				flushed[i] = head;
+			}
+			if (fp) fflush(fp);
+		}
+};
+
+#endif
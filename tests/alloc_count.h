@@ -0,0 +1,135 @@
+#ifndef _ALLOC_COUNT_H
+#define _ALLOC_COUNT_H
+
+/*
+ * Replaces the global operator new and delete with versions that can
+ * count the allocations made by any thread, so a test can check that a
+ * code path never touches the heap.  Counting is off unless a test
+ * turns it on with countAllocations(true), and while it is off an
+ * allocation only pays for one relaxed load of a flag that no one
+ * writes, so the other tests in the binary are timed as before.
+ *
+ * Replacement operators must be defined in exactly one translation
+ * unit of a program, so like tests.h this header is only included by a
+ * driver's main file.
+ */
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<bool> counting_allocations(false);
+static std::atomic<long long> heap_allocations(0);
+
+// starts or stops counting allocations from every thread
+inline void countAllocations(bool enabled) {
+    counting_allocations.store(enabled, std::memory_order_relaxed);
+}
+
+// heap allocations counted so far
+inline long long heapAllocations() {
+    return heap_allocations.load(std::memory_order_relaxed);
+}
+
+inline void *countedMalloc(size_t size) {
+    if (counting_allocations.load(std::memory_order_relaxed)) {
+        heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return malloc(size ? size : 1);
+}
+
+// all kept out of line so that GCC does not see through them and warn
+// that a new expression is paired with free()
+__attribute__((noinline)) void *operator new(size_t size) {
+    void *p = countedMalloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+__attribute__((noinline)) void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return countedMalloc(size);
+}
+
+__attribute__((noinline)) void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return countedMalloc(size);
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+#ifdef __cpp_aligned_new
+// over-aligned types, C++17 and later
+inline void *countedAlignedAlloc(size_t size, std::align_val_t alignment) {
+    if (counting_allocations.load(std::memory_order_relaxed)) {
+        heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void *p = NULL;
+    size_t align = static_cast<size_t>(alignment);
+    if (align < sizeof(void*)) align = sizeof(void*);
+    if (posix_memalign(&p, align, size ? size : 1) != 0) {
+        return NULL;
+    }
+    return p;
+}
+
+__attribute__((noinline)) void *operator new(size_t size, std::align_val_t alignment) {
+    void *p = countedAlignedAlloc(size, alignment);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void *operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+__attribute__((noinline)) void *operator new(size_t size, std::align_val_t alignment,
+                                             const std::nothrow_t &) noexcept {
+    return countedAlignedAlloc(size, alignment);
+}
+
+__attribute__((noinline)) void *operator new[](size_t size, std::align_val_t alignment,
+                                               const std::nothrow_t &) noexcept {
+    return countedAlignedAlloc(size, alignment);
+}
+
+__attribute__((noinline)) void operator delete(void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, std::align_val_t,
+                                               const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, std::align_val_t,
+                                                 const std::nothrow_t &) noexcept {
+    free(p);
+}
+#endif
+
+#endif
@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <assert.h>
+
+#include "tasksys.h"
+#include "tests.h"
+#include "taskcoro.h"
+
+/*
+ * Driver for the C++20 coroutine adaptor in taskcoro.h.  A coroutine
+ * awaits a chain of ping-pong bulk launches one at a time, either
+ * resuming on pool workers or on the main thread through an executor,
+ * and the results are checked like pingPongTest() does.
+ */
+
+#define DEFAULT_NUM_THREADS 8
+#define DEFAULT_NUM_TIMING_ITERATIONS 3
+
+/*
+ * Fire-and-forget coroutine type: starts eagerly and frees its frame
+ * when it finishes.
+ */
+struct DetachedCoroutine {
+    struct promise_type {
+        DetachedCoroutine get_return_object() { return DetachedCoroutine(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { abort(); }
+    };
+};
+
+/*
+ * Executor that queues coroutines and resumes them on the thread that
+ * calls runUntil().
+ */
+class MainThreadExecutor {
+    private:
+        std::mutex m;
+        std::condition_variable cond;
+        std::deque<std::coroutine_handle<>> ready;
+        bool finished;
+    public:
+        MainThreadExecutor() : finished(false) {}
+        void post(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> lck(m);
+            ready.push_back(handle);
+            cond.notify_one();
+        }
+        void finish() {
+            std::lock_guard<std::mutex> lck(m);
+            finished = true;
+            cond.notify_one();
+        }
+        void runUntilFinished() {
+            std::unique_lock<std::mutex> lck(m);
+            while (true) {
+                cond.wait(lck, [this]{ return finished || !ready.empty(); });
+                if (ready.empty()) return;
+                std::coroutine_handle<> handle = ready.front();
+                ready.pop_front();
+                lck.unlock();
+                handle.resume();
+                lck.lock();
+            }
+        }
+};
+
+/*
+ * Signals the main thread once the coroutine completes.
+ */
+class Latch {
+    private:
+        std::mutex m;
+        std::condition_variable cond;
+        bool done;
+    public:
+        Latch() : done(false) {}
+        void count_down() {
+            std::lock_guard<std::mutex> lck(m);
+            done = true;
+            cond.notify_one();
+        }
+        void wait() {
+            std::unique_lock<std::mutex> lck(m);
+            cond.wait(lck, [this]{ return done; });
+        }
+};
+
+DetachedCoroutine pingPongCoroutine(AwaitableTaskSystem &system,
+                                    std::vector<PingPongTask*> &runnables,
+                                    int num_tasks, std::function<void()> on_done) {
+    TaskID prev_task_id = -1;
+    for (size_t i = 0; i < runnables.size(); i++) {
+        std::vector<TaskID> deps;
+        if (i > 0) {
+            deps.push_back(prev_task_id);
+        }
+        prev_task_id = co_await system.launch(runnables[i], num_tasks, deps);
+    }
+    on_done();
+}
+
+TestResults coroPingPongTest(ITaskSystem *t, bool use_executor) {
+    int num_elements = 32 * 1024;
+    int base_iters = 32;
+    int num_tasks = 64;
+    int num_bulk_task_launches = 400;
+
+    int* input = new int[num_elements];
+    int* output = new int[num_elements];
+    for (int i = 0; i < num_elements; i++) {
+        input[i] = i;
+        output[i] = 0;
+    }
+
+    std::vector<PingPongTask*> runnables(num_bulk_task_launches);
+    for (int i = 0; i < num_bulk_task_launches; i++) {
+        if (i % 2 == 0)
+            runnables[i] = new PingPongTask(num_elements, input, output, true, base_iters);
+        else
+            runnables[i] = new PingPongTask(num_elements, output, input, true, base_iters);
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    if (use_executor) {
+        MainThreadExecutor executor;
+        AwaitableTaskSystem system(t, [&executor](std::coroutine_handle<> h) {
+            executor.post(h);
+        });
+        pingPongCoroutine(system, runnables, num_tasks, [&executor]{ executor.finish(); });
+        executor.runUntilFinished();
+    } else {
+        Latch latch;
+        AwaitableTaskSystem system(t);
+        pingPongCoroutine(system, runnables, num_tasks, [&latch]{ latch.count_down(); });
+        latch.wait();
+    }
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults results;
+    results.passed = true;
+    int* buffer = (num_bulk_task_launches % 2 == 1) ? output : input;
+    for (int i = 0; i < num_elements; i++) {
+        int value = i;
+        for (int j = 0; j < num_bulk_task_launches; j++) {
+            value = PingPongTask::ping_pong_work(base_iters, value);
+        }
+        if (buffer[i] != value) {
+            results.passed = false;
+            printf("%d: %d expected=%d\n", i, buffer[i], value);
+            break;
+        }
+    }
+    results.time = end_time - start_time;
+
+    delete [] input;
+    delete [] output;
+    for (int i = 0; i < num_bulk_task_launches; i++)
+        delete runnables[i];
+
+    return results;
+}
+
+TestResults coroPingPongWorkerTest(ITaskSystem *t) {
+    return coroPingPongTest(t, false);
+}
+
+TestResults coroPingPongExecutorTest(ITaskSystem *t) {
+    return coroPingPongTest(t, true);
+}
+
+DetachedCoroutine completedLaunchesCoroutine(AwaitableTaskSystem &system, IRunnable *runnable,
+                                             int num_launches, int *awaited) {
+    for (int i = 0; i < num_launches; i++) {
+        co_await system.launch(runnable, 1);
+        (*awaited)++;
+    }
+}
+
+/*
+ * Awaits a million launches that have already completed when they are
+ * awaited, as every launch has on the Serial task system.  Each co_await
+ * must continue without nesting a resume() inside the previous one, or
+ * the stack overflows.
+ */
+TestResults coroCompletedLaunchesTest(ITaskSystem *t) {
+    int num_launches = 1000 * 1000;
+    CountTask task;
+    int awaited = 0;
+
+    double start_time = CycleTimer::currentSeconds();
+    AwaitableTaskSystem system(t);
+    completedLaunchesCoroutine(system, &task, num_launches, &awaited);
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults results;
+    results.passed = awaited == num_launches && task.tasks_run == num_launches;
+    results.time = end_time - start_time;
+    return results;
+}
+
+enum TaskSystemType {
+    SERIAL,
+    PARALLEL_THREAD_POOL_SLEEPING,
+    N_TASKSYS_IMPLS, // This must be in the last position.
+};
+
+ITaskSystem *selectTaskSystemRefImpl(int num_threads, TaskSystemType type) {
+    assert(type < N_TASKSYS_IMPLS);
+
+    if (type == SERIAL) {
+        return new TaskSystemSerial(num_threads);
+    } else if (type == PARALLEL_THREAD_POOL_SLEEPING) {
+        return new TaskSystemParallelThreadPoolSleeping(num_threads);
+    } else {
+        return NULL;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int num_threads = DEFAULT_NUM_THREADS;
+    int num_timing_iterations = DEFAULT_NUM_TIMING_ITERATIONS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:i:?")) != EOF) {
+        switch (opt) {
+        case 'n':
+            num_threads = atoi(optarg);
+            break;
+        case 'i':
+            num_timing_iterations = atoi(optarg);
+            break;
+        default:
+            printf("Usage: %s [-n num_threads] [-i num_timing_iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    TestResults (*test[])(ITaskSystem*) = {
+        coroPingPongWorkerTest,
+        coroPingPongExecutorTest,
+        coroCompletedLaunchesTest,
+    };
+    const char *test_names[] = {
+        "coro_ping_pong_resume_on_worker",
+        "coro_ping_pong_resume_on_executor",
+        "coro_completed_launches",
+    };
+    // a million launches through the thread pool would take minutes
+    const bool serial_only[] = {
+        false,
+        false,
+        true,
+    };
+
+    for (size_t test_id = 0; test_id < sizeof(test) / sizeof(test[0]); test_id++) {
+        printf("============================================================="
+               "======================\n");
+        printf("Test name: %s\n", test_names[test_id]);
+        printf("============================================================="
+               "======================\n");
+        for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
+            if (serial_only[test_id] && i != SERIAL) {
+                continue;
+            }
+            double minT = 1e30;
+            const char *name = NULL;
+            for (int j = 0; j < num_timing_iterations; j++) {
+                ITaskSystem *t = selectTaskSystemRefImpl(num_threads, (TaskSystemType) i);
+                TestResults result = test[test_id](t);
+                if (!result.passed) {
+                    printf("ERROR: Results did not pass correctness check! (iter=%d, ref_impl=%s)\n",
+                        j, t->name());
+                    exit(1);
+                }
+                minT = std::min(minT, result.time);
+                name = t->name();
+                delete t;
+            }
+            printf("[%s]:\t\t[%.3f] ms\n", name, minT * 1000);
+        }
+    }
+    printf("============================================================="
+           "======================\n");
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+#ifndef _DAG_H
+#define _DAG_H
+
+/*
+ * Synthetic task graphs for benchmarking dependency handling.  A graph
+ * is a list of bulk task launches in submission order; every launch
+ * depends only on earlier launches, so the list can be submitted to
+ * runAsyncWithDeps() front to back.  Graphs and per-task costs are
+ * fully determined by the DagSpec, including its seed.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+enum DagShape {
+    // each launch depends on the previous one
+    DAG_CHAIN,
+    // a root, `width` launches depending on it, and a join depending on
+    // all of them, repeated with the join as the next root
+    DAG_FAN_OUT_FAN_IN,
+    // reduction tree: leaves first, then each node joins two nodes of
+    // the level below
+    DAG_BINARY_TREE,
+    // layers of `width` launches, each depending on 1..`degree`
+    // random launches of the previous layer
+    DAG_LAYERED,
+    // random recursive series and parallel composition
+    DAG_SERIES_PARALLEL,
+    // each launch depends on 0..2*`degree` random earlier launches
+    DAG_RANDOM,
+};
+
+enum CostDistribution {
+    COST_ZERO,
+    // every task costs cost_us
+    COST_CONSTANT,
+    // uniform in [0, 2 * cost_us]
+    COST_UNIFORM,
+    // exponential with mean cost_us
+    COST_EXPONENTIAL,
+    // 90% of tasks cost cost_us / 5, the rest 8.2 * cost_us (mean cost_us)
+    COST_BIMODAL,
+};
+
+typedef struct {
+    DagShape shape;
+    int num_launches;
+    int width;
+    int degree;
+    // tasks per launch are uniform in [min_tasks, max_tasks]
+    int min_tasks;
+    int max_tasks;
+    CostDistribution cost;
+    // mean task cost in microseconds
+    double cost_us;
+    unsigned int seed;
+} DagSpec;
+
+typedef struct {
+    // deps[i] lists the launches (all < i) that launch i depends on
+    std::vector<std::vector<int> > deps;
+    std::vector<int> num_tasks;
+} Dag;
+
+/*
+ * splitmix64: a small, fast, well-mixed generator, also usable as a
+ * hash so that a task's cost can be derived from (seed, launch, task)
+ * without storing it.
+ */
+inline uint64_t dagMix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+class DagRandom {
+    private:
+        uint64_t state;
+    public:
+        DagRandom(uint64_t seed) : state(seed) {}
+        uint64_t next() {
+            state += 0x9e3779b97f4a7c15ULL;
+            return dagMix(state);
+        }
+        // uniform in [0, n)
+        int below(int n) {
+            return next() % n;
+        }
+        // uniform in [lo, hi]
+        int between(int lo, int hi) {
+            return lo + below(hi - lo + 1);
+        }
+};
+
+// uniform in [0, 1)
+inline double dagUnit(uint64_t bits) {
+    return (bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+inline double dagTaskCost(const DagSpec &spec, int launch, int task) {
+    uint64_t bits = dagMix(dagMix(dagMix(spec.seed) ^ launch) ^ task);
+    double u = dagUnit(bits);
+    switch (spec.cost) {
+    case COST_CONSTANT:
+        return spec.cost_us;
+    case COST_UNIFORM:
+        return 2 * spec.cost_us * u;
+    case COST_EXPONENTIAL:
+        return -spec.cost_us * log(1 - u);
+    case COST_BIMODAL:
+        return u < 0.9 ? spec.cost_us / 5 : 8.2 * spec.cost_us;
+    default:
+        return 0;
+    }
+}
+
+// adds `count` launches composed in series or parallel after `sources`
+// and returns the launches nothing in the composition depends on
+static void dagSeriesParallel(Dag &dag, DagRandom &rng, int count,
+                              const std::vector<int> &sources, std::vector<int> &sinks) {
+    if (count == 1) {
+        sinks.assign(1, (int) dag.deps.size());
+        dag.deps.push_back(sources);
+        return;
+    }
+    int first = rng.between(1, count - 1);
+    if (rng.below(2) == 0) {
+        std::vector<int> middle;
+        dagSeriesParallel(dag, rng, first, sources, middle);
+        dagSeriesParallel(dag, rng, count - first, middle, sinks);
+    } else {
+        std::vector<int> other;
+        dagSeriesParallel(dag, rng, first, sources, sinks);
+        dagSeriesParallel(dag, rng, count - first, sources, other);
+        sinks.insert(sinks.end(), other.begin(), other.end());
+    }
+}
+
+Dag generateDag(const DagSpec &spec) {
+    Dag dag;
+    DagRandom rng(spec.seed);
+    int n = std::max(1, spec.num_launches);
+    int width = std::max(1, spec.width);
+    int degree = std::max(1, spec.degree);
+
+    switch (spec.shape) {
+    case DAG_CHAIN:
+        for (int i = 0; i < n; i++) {
+            dag.deps.push_back(i ? std::vector<int>(1, i - 1) : std::vector<int>());
+        }
+        break;
+    case DAG_FAN_OUT_FAN_IN: {
+        dag.deps.push_back(std::vector<int>());
+        int root = 0;
+        while ((int) dag.deps.size() < n) {
+            int fan = std::min(width, n - (int) dag.deps.size());
+            std::vector<int> join;
+            for (int i = 0; i < fan; i++) {
+                join.push_back(dag.deps.size());
+                dag.deps.push_back(std::vector<int>(1, root));
+            }
+            if ((int) dag.deps.size() < n) {
+                root = dag.deps.size();
+                dag.deps.push_back(join);
+            }
+        }
+        break;
+    }
+    case DAG_BINARY_TREE: {
+        std::vector<int> level;
+        for (int i = 0; i < (n + 1) / 2; i++) {
+            level.push_back(dag.deps.size());
+            dag.deps.push_back(std::vector<int>());
+        }
+        while (level.size() > 1) {
+            std::vector<int> next;
+            for (size_t i = 0; i + 1 < level.size(); i += 2) {
+                next.push_back(dag.deps.size());
+                std::vector<int> pair;
+                pair.push_back(level[i]);
+                pair.push_back(level[i + 1]);
+                dag.deps.push_back(pair);
+            }
+            if (level.size() % 2 == 1) {
+                next.push_back(level.back());
+            }
+            level.swap(next);
+        }
+        break;
+    }
+    case DAG_LAYERED:
+        for (int i = 0; i < n; i++) {
+            int layer_start = i - i % width;
+            std::vector<int> deps;
+            if (layer_start > 0) {
+                int count = rng.between(1, degree);
+                for (int j = 0; j < count; j++) {
+                    deps.push_back(layer_start - width + rng.below(width));
+                }
+            }
+            dag.deps.push_back(deps);
+        }
+        break;
+    case DAG_SERIES_PARALLEL: {
+        std::vector<int> sinks;
+        dagSeriesParallel(dag, rng, n, std::vector<int>(), sinks);
+        break;
+    }
+    case DAG_RANDOM:
+        for (int i = 0; i < n; i++) {
+            std::vector<int> deps;
+            int count = i ? rng.between(0, 2 * degree) : 0;
+            for (int j = 0; j < count; j++) {
+                deps.push_back(rng.below(i));
+            }
+            dag.deps.push_back(deps);
+        }
+        break;
+    }
+
+    for (size_t i = 0; i < dag.deps.size(); i++) {
+        std::vector<int> &deps = dag.deps[i];
+        std::sort(deps.begin(), deps.end());
+        deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+        dag.num_tasks.push_back(rng.between(std::max(1, spec.min_tasks),
+                                            std::max(1, std::max(spec.min_tasks, spec.max_tasks))));
+    }
+    return dag;
+}
+
+#endif
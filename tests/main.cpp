@@ -2,22 +2,35 @@
 #include <stdio.h>
 #include <getopt.h>
 #include <string>
+#include <map>
 #include <assert.h>
 
 #include "tasksys.h"
 #include "tests.h"
+#include "report.h"
 
 #define DEFAULT_NUM_THREADS 8
 #define DEFAULT_NUM_TIMING_ITERATIONS 3
 
 
 void usage(const char* progname, std::string *testnames, int num_tests) {
-    printf("Usage: %s [options] testname\n", progname);
+    printf("Usage: %s [options] testname|all\n", progname);
     printf("Program Options:\n");
     printf("  -n  --num_threads  <INT>      Number of threads: <INT> (default=%d)\n", DEFAULT_NUM_THREADS);
     printf("  -i  --num_timing_iterations <INT> Number of timing iterations: <INT> (default=%d)\n", DEFAULT_NUM_TIMING_ITERATIONS);
+    printf("  -s  --stats                   Print scheduler statistics of the last iteration\n");
+    printf("  -p  --profile                 Print the work/span profile and scheduling latencies\n");
+    printf("                                of the last iteration\n");
+    printf("  -c  --counters                Print hardware counters of the last iteration\n");
+    printf("  -f  --format <text|json|csv>  Output format (default=text); -s, -p and -c\n");
+    printf("                                only apply to text output\n");
+    printf("  -t  --sweep <LIST>            Time every thread count in LIST (e.g. 1,2,4,8 or\n");
+    printf("                                1-16) and report speedup and efficiency\n");
+    printf("  -w  --warm                    Reuse one task system per implementation and thread\n");
+    printf("                                count across iterations and tests\n");
+    printf("  -d  --reduce_deps             Drop dependencies implied by other dependencies\n");
     printf("  -?  --help                    This message\n");
-    printf("Valid testnames are:");
+    printf("'all' runs every test in one process. Valid testnames are:");
     for(int i = 0; i < num_tests; i++) {
         printf(" %s%c", testnames[i].c_str(), (char)((i+1 == num_tests) ? '\n' : ','));
     }
@@ -47,13 +60,336 @@ ITaskSystem *selectTaskSystemRefImpl(int num_threads, TaskSystemType type) {
     }
 }
 
+void printStats(ITaskSystem *t) {
+    TaskSystemStats stats = t->getStats();
+    if (stats.workers.empty() && stats.continuations_run == 0 &&
+        stats.dependencies_listed == 0 && stats.launches_inlined == 0) {
+        return;
+    }
+    printf("  %-6s %10s %8s %8s %10s %8s %8s %10s %10s\n", "worker", "tasks",
+           "chunks", "launches", "dep_polls", "parks", "wakeups", "busy_ms", "idle_ms");
+    for (size_t i = 0; i < stats.workers.size(); i++) {
+        const WorkerStats &w = stats.workers[i];
+        printf("  %-6d %10lld %8lld %8lld %10lld %8lld %8lld %10.3f %10.3f\n", (int) i,
+               w.tasks_executed, w.chunks_claimed, w.launches, w.dep_polls_failed,
+               w.parks, w.wakeups, w.busy_time * 1000, w.idle_time * 1000);
+    }
+    if (stats.continuations_run > 0) {
+        printf("  continuations: %lld (%.3f ms)\n", stats.continuations_run,
+               stats.continuation_time * 1000);
+    }
+    if (stats.dependencies_listed > 0) {
+        printf("  dependencies: %lld listed, %lld tracked\n", stats.dependencies_listed,
+               stats.dependencies_tracked);
+    }
+    if (stats.launches_inlined > 0) {
+        printf("  launches run inline: %lld\n", stats.launches_inlined);
+    }
+}
+
+void printProfile(ITaskSystem *t, int num_threads) {
+    TaskGraphProfile profile = t->getProfile();
+    if (profile.launches == 0) {
+        return;
+    }
+    // a greedy scheduler is never slower than work / P + span
+    double greedy_bound = profile.work / num_threads + profile.span;
+    printf("  launches: %lld  work: %.3f ms  span: %.3f ms  parallelism: %.2f\n",
+           profile.launches, profile.work * 1000, profile.span * 1000,
+           profile.span > 0 ? profile.work / profile.span : 0.0);
+    printf("  makespan: %.3f ms  greedy bound (%d threads): %.3f ms  ratio: %.2f\n",
+           profile.makespan * 1000, num_threads, greedy_bound * 1000,
+           greedy_bound > 0 ? profile.makespan / greedy_bound : 0.0);
+
+    TaskSystemLatencies latencies = t->getLatencies();
+    const char *names[] = { "submit->start", "dep->ready", "wakeup" };
+    const LatencySummary *summaries[] = {
+        &latencies.submit_to_start, &latencies.dependency_release, &latencies.wakeup,
+    };
+    printf("  %-14s %10s %10s %10s %10s %10s\n", "latency", "count",
+           "p50_us", "p99_us", "p999_us", "max_us");
+    for (int i = 0; i < 3; i++) {
+        const LatencySummary &l = *summaries[i];
+        printf("  %-14s %10lld %10.2f %10.2f %10.2f %10.2f\n", names[i], l.count,
+               l.p50 * 1e6, l.p99 * 1e6, l.p999 * 1e6, l.max * 1e6);
+    }
+}
+
+void printCount(const char *label, long long count) {
+    if (count < 0) {
+        printf("  %s: n/a", label);
+    } else {
+        printf("  %s: %lld", label, count);
+    }
+}
+
+void printHardwareCounters(ITaskSystem *t) {
+    HardwareCounters hw = t->getHardwareCounters();
+    if (hw.cycles < 0) {
+        printf("  hardware counters: unavailable\n");
+        return;
+    }
+    printCount("cycles", hw.cycles);
+    printCount("instructions", hw.instructions);
+    if (hw.instructions >= 0 && hw.cycles > 0) {
+        printf("  IPC: %.2f", (double) hw.instructions / hw.cycles);
+    }
+    printCount("LLC misses", hw.llc_misses);
+    printCount("branch misses", hw.branch_misses);
+    if (hw.scaled) {
+        printf("  (scaled: counters were multiplexed)");
+    }
+    printf("\n");
+}
+
+typedef struct {
+    // print the best time of each implementation as it finishes
+    bool print_times;
+    bool print_stats;
+    bool print_profile;
+    bool print_counters;
+    // see ITaskSystem::setDependencyReduction()
+    bool reduce_deps;
+    // otherwise a failed run is reported and the test skipped
+    bool exit_on_failure;
+} RunOptions;
+
+/*
+ * Task systems kept alive across iterations and tests in warm mode, one
+ * per implementation and thread count.
+ */
+class WarmSystems {
+    private:
+        std::map<std::pair<int, int>, ITaskSystem*> systems;
+    public:
+        ITaskSystem *get(TaskSystemType type, int num_threads) {
+            ITaskSystem *&t = systems[std::make_pair((int) type, num_threads)];
+            if (!t) {
+                t = selectTaskSystemRefImpl(num_threads, type);
+            }
+            return t;
+        }
+        ~WarmSystems() {
+            for (auto i = systems.begin(); i != systems.end(); ++i) {
+                delete i->second;
+            }
+        }
+};
+
+// bytes per second in each unit bandwidth is printed in, see
+// TestResults::report_mb
+double bandwidthUnit(bool report_mb) {
+    return report_mb ? 1e6 : 1e9;
+}
+
+const char *bandwidthUnitName(bool report_mb) {
+    return report_mb ? "MB/s" : "GB/s";
+}
+
+/*
+ * Runs `test` num_timing_iterations times on implementation `type`,
+ * creating a new task system for every run so each timing run is from
+ * a clean start, or reusing the one in `warm` if given, and returns the
+ * run times in seconds, or none if a run fails its correctness check
+ * (which exits instead unless running all tests).
+ * Statistics, profile and counters are printed for the last run; in
+ * warm mode statistics and counters accumulate over every run of the
+ * task system.
+ */
+std::vector<double> timeTest(TestResults (*test)(ITaskSystem*), TaskSystemType type,
+                             int num_threads, int num_timing_iterations,
+                             const RunOptions &options, WarmSystems *warm,
+                             std::string *impl_name, double *bytes, bool *report_mb) {
+    std::vector<double> times;
+    for (int j = 0; j < num_timing_iterations; j++) {
+
+        // Create a new task system
+        ITaskSystem *t = warm ? warm->get(type, num_threads)
+                              : selectTaskSystemRefImpl(num_threads, type);
+        if (options.print_profile) {
+            // restart the profile at this run
+            t->setProfiling(false);
+            t->setProfiling(true);
+        }
+        if (options.print_counters) {
+            t->setHardwareCounters(true);
+        }
+        if (options.print_stats) {
+            t->setStatistics(true);
+        }
+        t->setDependencyReduction(options.reduce_deps);
+
+        // Run test
+        TestResults result = test(t);
+
+        // Check that the test result was correct
+        if (!result.passed) {
+            printf("ERROR: Results did not pass correctness check! (iter=%d, ref_impl=%s)\n",
+                j, t->name());
+            if (options.exit_on_failure) {
+                exit(1);
+            }
+            if (!warm) {
+                delete t;
+            }
+            times.clear();
+            return times;
+        }
+
+        times.push_back(result.time);
+        *impl_name = t->name();
+        *bytes = result.bytes;
+        *report_mb = result.report_mb;
+
+        if (j+1 == num_timing_iterations) {
+            if (options.print_times) {
+                double minT = *std::min_element(times.begin(), times.end());
+                if (result.bytes > 0) {
+                    printf("[%s]:\t\t[%.3f] ms\t[%.2f %s]\n", t->name(), minT * 1000,
+                           result.bytes / minT / bandwidthUnit(result.report_mb),
+                           bandwidthUnitName(result.report_mb));
+                } else {
+                    printf("[%s]:\t\t[%.3f] ms\n", t->name(), minT * 1000);
+                }
+            }
+            if (options.print_counters) {
+                printHardwareCounters(t);
+            }
+            if (options.print_stats) {
+                printStats(t);
+            }
+            if (options.print_profile) {
+                printProfile(t, num_threads);
+            }
+        }
+
+        // Shutdown task system so each timing run is from a clean start
+        if (!warm) {
+            delete t;
+        }
+    }
+    return times;
+}
+
+/*
+ * Parses a list of thread counts such as "1,2,4,8", "1-16" or
+ * "1-4,8,16" into a sorted list without duplicates.  1 is always
+ * included since it is the baseline for speedups.
+ */
+bool parseThreadCounts(const char *spec, std::vector<int> *counts) {
+    counts->clear();
+    counts->push_back(1);
+    const char *p = spec;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 1) return false;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) return false;
+            p = end;
+        }
+        for (long n = first; n <= last; n++) {
+            counts->push_back(n);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return false;
+        }
+    }
+    std::sort(counts->begin(), counts->end());
+    counts->erase(std::unique(counts->begin(), counts->end()), counts->end());
+    return true;
+}
+
+// more threads than the knee improve the best time by less than this
+#define SCALING_TOLERANCE 1.1
+
+/*
+ * Times every parallel implementation at each thread count and reports
+ * speedup and efficiency relative to the same implementation on one
+ * thread, and speedup relative to TaskSystemSerial.  The thread count
+ * where scaling stops is the smallest one whose time is within 10% of
+ * the best time of the sweep.  Returns false if a run failed.
+ */
+bool sweepThreads(TestResults (*test)(ITaskSystem*), const std::string &test_name,
+                  const std::vector<int> &counts, int num_timing_iterations,
+                  const RunOptions &options, WarmSystems *warm, Report &report) {
+    bool text = report.getFormat() == FORMAT_TEXT;
+    // only the print flags differ, so options added later carry over
+    RunOptions quiet = options;
+    quiet.print_times = false;
+    quiet.print_stats = false;
+    quiet.print_profile = false;
+    quiet.print_counters = false;
+    std::string impl_name;
+    double bytes;
+    bool report_mb;
+
+    std::vector<double> times = timeTest(test, SERIAL, 1, num_timing_iterations, quiet, warm,
+                                         &impl_name, &bytes, &report_mb);
+    if (times.empty()) {
+        return false;
+    }
+    report.add(test_name, impl_name, 1, times, bytes);
+    double serial_time = *std::min_element(times.begin(), times.end());
+    if (text) {
+        printf("[%s]:\t\t[%.3f] ms\n", impl_name.c_str(), serial_time * 1000);
+    }
+
+    for (int i = SERIAL + 1; i < N_TASKSYS_IMPLS; i++) {
+        std::vector<double> best;
+        for (size_t k = 0; k < counts.size(); k++) {
+            times = timeTest(test, (TaskSystemType) i, counts[k], num_timing_iterations,
+                             quiet, warm, &impl_name, &bytes, &report_mb);
+            if (times.empty()) {
+                return false;
+            }
+            report.add(test_name, impl_name, counts[k], times, bytes);
+            best.push_back(*std::min_element(times.begin(), times.end()));
+        }
+        if (!text) {
+            continue;
+        }
+
+        double fastest = *std::min_element(best.begin(), best.end());
+        size_t knee = 0;
+        while (best[knee] > fastest * SCALING_TOLERANCE) {
+            knee++;
+        }
+        printf("[%s]:\n", impl_name.c_str());
+        printf("  %8s %12s %8s %11s %10s", "threads", "time_ms", "speedup",
+               "efficiency", "vs_serial");
+        printf(bytes > 0 ? " %8s\n" : "\n", bandwidthUnitName(report_mb));
+        for (size_t k = 0; k < counts.size(); k++) {
+            double speedup = best[0] / best[k];
+            printf("  %8d %12.3f %8.2f %11.2f %10.2f", counts[k], best[k] * 1000,
+                   speedup, speedup / counts[k], serial_time / best[k]);
+            if (bytes > 0) {
+                printf(" %8.2f", bytes / best[k] / bandwidthUnit(report_mb));
+            }
+            printf("%s\n", k == knee && knee + 1 < counts.size() ? "  <- scaling stops" : "");
+        }
+    }
+    return true;
+}
+
 int main(int argc, char** argv)
 {
-    const int n_tests = 31;
     int num_threads = DEFAULT_NUM_THREADS;
     int num_timing_iterations = DEFAULT_NUM_TIMING_ITERATIONS;
+    bool print_stats = false;
+    bool print_profile = false;
+    bool print_counters = false;
+    ReportFormat format = FORMAT_TEXT;
+    std::vector<int> thread_counts;
+    bool warm_mode = false;
+    bool reduce_deps = false;
 
-    TestResults (*test[n_tests])(ITaskSystem*) = {
+    TestResults (*test[])(ITaskSystem*) = {
         simpleTestSync,
         simpleTestAsync,
         pingPongEqualTest,
@@ -66,6 +402,7 @@ int main(int argc, char** argv)
         mathOperationsInTightForLoopFanInTest,
         mathOperationsInTightForLoopReductionTreeTest,
         spinBetweenRunCallsTest,
+        largeRunAfterSmallTest,
         mandelbrotChunkedTest,
         pingPongEqualAsyncTest,
         pingPongUnequalAsyncTest,
@@ -78,14 +415,51 @@ int main(int argc, char** argv)
         mathOperationsInTightForLoopReductionTreeAsyncTest,
         mandelbrotChunkedAsyncTest,
         spinBetweenRunCallsAsyncTest,
+        tinyRunsBetweenAsyncTest,
         simpleRunDepsTest,
         strictDiamondDepsTest,
         strictGraphDepsSmall,
         strictGraphDepsMedium,
         strictGraphDepsLarge,
+        strictGraphDepsLargeReduced,
+        continuationTest,
+        steadyStateAllocationsTest,
+        superSuperLightParallelForTest,
+        superSuperLightParallelForAsyncTest,
+        parallelReduceTest,
+        parallelReduceDeterministicTest,
+        parallelScan1MTest,
+        parallelScan16MTest,
+        parallelExclusiveScan16MTest,
+        serialScan1MTest,
+        serialScan16MTest,
+        dagChainTest,
+        dagFanOutFanInTest,
+        dagBinaryTreeTest,
+        dagLayeredTest,
+        dagSeriesParallelTest,
+        dagRandomTest,
+        dagRandom1MTest,
+        streamTriadTest,
+        streamTriadAsyncTest,
+        jacobi2DTest,
+        jacobi2DAsyncTest,
+        jacobi3DTest,
+        jacobi3DAsyncTest,
+        gatherScatterTest,
+        gatherScatterAsyncTest,
+        mandelbrotChunkedSimdTest,
+        mandelbrotChunkedSimdAsyncTest,
+        mandelbrotTiledTest,
+        mandelbrotTiledMortonTest,
+        mandelbrotTiledHilbertTest,
+        mandelbrotTiledSmallHilbertTest,
+        mandelbrotTiledHilbertAsyncTest,
+        ppmWriteTest,
+        ppmWriteMmapTest,
     };
 
-    std::string test_names[n_tests] = {
+    std::string test_names[] = {
         "simple_test_sync",
         "simple_test_async",
         "ping_pong_equal",
@@ -98,6 +472,7 @@ int main(int argc, char** argv)
         "math_operations_in_tight_for_loop_fan_in",
         "math_operations_in_tight_for_loop_reduction_tree",
         "spin_between_run_calls",
+        "large_run_after_small",
         "mandelbrot_chunked",
         "ping_pong_equal_async",
         "ping_pong_unequal_async",
@@ -110,22 +485,70 @@ int main(int argc, char** argv)
         "math_operations_in_tight_for_loop_reduction_tree_async",
         "mandelbrot_chunked_async",
         "spin_between_run_calls_async",
+        "tiny_runs_between_async",
         "simple_run_deps_test",
         "strict_diamond_deps_async",
         "strict_graph_deps_small_async",
         "strict_graph_deps_med_async",
         "strict_graph_deps_large_async",
+        "strict_graph_deps_large_reduced_async",
+        "continuation_async",
+        "steady_state_allocations_async",
+        "super_super_light_parallel_for",
+        "super_super_light_parallel_for_async",
+        "parallel_reduce",
+        "parallel_reduce_deterministic",
+        "parallel_scan_1m",
+        "parallel_scan_16m",
+        "parallel_exclusive_scan_16m",
+        "serial_scan_1m",
+        "serial_scan_16m",
+        "dag_chain_async",
+        "dag_fan_out_fan_in_async",
+        "dag_binary_tree_async",
+        "dag_layered_async",
+        "dag_series_parallel_async",
+        "dag_random_async",
+        "dag_random_1m_async",
+        "stream_triad",
+        "stream_triad_async",
+        "jacobi_2d",
+        "jacobi_2d_async",
+        "jacobi_3d",
+        "jacobi_3d_async",
+        "gather_scatter",
+        "gather_scatter_async",
+        "mandelbrot_chunked_simd",
+        "mandelbrot_chunked_simd_async",
+        "mandelbrot_tiled",
+        "mandelbrot_tiled_morton",
+        "mandelbrot_tiled_hilbert",
+        "mandelbrot_tiled_hilbert_8",
+        "mandelbrot_tiled_hilbert_async",
+        "ppm_write",
+        "ppm_write_mmap",
     };
+    const int n_tests = sizeof(test) / sizeof(test[0]);
+    static_assert(sizeof(test) / sizeof(test[0]) == sizeof(test_names) / sizeof(test_names[0]),
+                  "every test needs a name");
  
     // Parse commandline options
     int opt;
     static struct option long_options[] = {
         {"num_threads",           1, 0,  'n'},
         {"num_timing_iterations", 1, 0,  'i'},
+        {"stats",                 0, 0,  's'},
+        {"profile",               0, 0,  'p'},
+        {"counters",              0, 0,  'c'},
+        {"format",                1, 0,  'f'},
+        {"sweep",                 1, 0,  't'},
+        {"warm",                  0, 0,  'w'},
+        {"reduce_deps",           0, 0,  'd'},
         {"help",                  0, 0,  '?'},
+        {0,                       0, 0,  0},
     };
 
-    while ((opt = getopt_long(argc, argv, "n:i:?", long_options, NULL)) != EOF) {
+    while ((opt = getopt_long(argc, argv, "n:i:spcf:t:wd?", long_options, NULL)) != EOF) {
 
         switch (opt) {
         case 'n':
@@ -134,6 +557,35 @@ int main(int argc, char** argv)
         case 'i':
             num_timing_iterations = atoi(optarg);
             break;
+        case 's':
+            print_stats = true;
+            break;
+        case 'p':
+            print_profile = true;
+            break;
+        case 'c':
+            print_counters = true;
+            break;
+        case 'f':
+            if (!parseReportFormat(optarg, &format)) {
+                fprintf(stderr, "Error: invalid format %s!\n", optarg);
+                usage(argv[0], test_names, n_tests);
+                return 1;
+            }
+            break;
+        case 't':
+            if (!parseThreadCounts(optarg, &thread_counts)) {
+                fprintf(stderr, "Error: invalid thread counts %s!\n", optarg);
+                usage(argv[0], test_names, n_tests);
+                return 1;
+            }
+            break;
+        case 'w':
+            warm_mode = true;
+            break;
+        case 'd':
+            reduce_deps = true;
+            break;
         case '?':
         default:
             usage(argv[0], test_names, n_tests);
@@ -149,55 +601,76 @@ int main(int argc, char** argv)
 
     std::string test_name = argv[optind];
 
+    bool text = format == FORMAT_TEXT;
+    print_stats = print_stats && text;
+    print_profile = print_profile && text;
+    print_counters = print_counters && text;
+    Report report(format);
+    report.begin();
+
+    bool run_all = test_name == "all";
+    RunOptions options = { text, print_stats, print_profile, print_counters, reduce_deps,
+                           !run_all };
+    WarmSystems warm_systems;
+    WarmSystems *warm = warm_mode ? &warm_systems : NULL;
+
+    std::vector<std::string> failed_tests;
     bool found = false;
     for (int test_id = 0; test_id < n_tests; test_id++) {
-        if (test_names[test_id].compare(test_name) != 0) {
+        if (!run_all && test_names[test_id].compare(test_name) != 0) {
             continue;
         }
 
         found = true;
-        printf("============================================================="
-               "======================\n");
-        printf("Test name: %s\n", test_names[test_id].c_str());
-        printf("============================================================="
-               "======================\n");
-
-        for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
-            double minT = 1e30;
-            for (int j = 0; j < num_timing_iterations; j++) {
-
-                // Create a new task system
-                ITaskSystem *t = selectTaskSystemRefImpl(num_threads, (TaskSystemType) i);
-
-                // Run test
-                TestResults result = test[test_id](t);
-
-                // Check that the test result was correct
-                if (!result.passed) {
-                    printf("ERROR: Results did not pass correctness check! (iter=%d, ref_impl=%s)\n",
-                        j, t->name());
-                    exit(1);
-                }
-
-                minT = std::min(minT, result.time);
+        if (text) {
+            printf("============================================================="
+                   "======================\n");
+            printf("Test name: %s%s\n", test_names[test_id].c_str(),
+                   thread_counts.empty() ? "" : " (thread sweep)");
+            printf("============================================================="
+                   "======================\n");
+        }
 
-                // TODO: do this better
-                if( j+1 == num_timing_iterations) {
-                    printf("[%s]:\t\t[%.3f] ms\n", t->name(), minT * 1000);
+        if (!thread_counts.empty()) {
+            if (!sweepThreads(test[test_id], test_names[test_id], thread_counts,
+                              num_timing_iterations, options, warm, report)) {
+                failed_tests.push_back(test_names[test_id]);
+            }
+        } else {
+            for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
+                std::string impl_name;
+                double bytes;
+                bool report_mb;
+                std::vector<double> times = timeTest(test[test_id], (TaskSystemType) i,
+                                                     num_threads, num_timing_iterations,
+                                                     options, warm, &impl_name, &bytes,
+                                                     &report_mb);
+                if (times.empty()) {
+                    failed_tests.push_back(test_names[test_id]);
+                    break;
                 }
-
-                // Shutdown task system so each timing run is from a clean start
-                delete t;
+                report.add(test_names[test_id], impl_name, num_threads, times, bytes);
             }
         }
-        printf("============================================================="
-               "======================\n");
+        if (text) {
+            printf("============================================================="
+                   "======================\n");
+        }
     }
     if (!found) {
         fprintf(stderr, "Error: invalid test_name!\n");
         usage(argv[0], test_names, n_tests);
         return 1;
     }
+    report.end();
 
+    if (!failed_tests.empty()) {
+        fprintf(stderr, "Failed correctness checks:");
+        for (size_t i = 0; i < failed_tests.size(); i++) {
+            fprintf(stderr, " %s", failed_tests[i].c_str());
+        }
+        fprintf(stderr, "\n");
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <string>
+#include <vector>
+#include <assert.h>
+
+#include "tasksys.h"
+#include "CycleTimer.h"
+#include "report.h"
+
+/*
+ * Launch-overhead microbenchmarks.  Each benchmark repeats one
+ * task-system operation on empty tasks, so the measured time is the
+ * runtime's own cost: launching, dependency tracking, synchronization
+ * and thread pool setup.  Every benchmark is warmed up, then timed in
+ * a number of samples of a batch of operations each, and reported per
+ * operation with the statistics of report.h.  The cost of the timer
+ * call that ends each sample, measured by CycleTimer::selfTest(), is
+ * subtracted from the sample.
+ */
+
+#define DEFAULT_NUM_THREADS 8
+#define DEFAULT_NUM_SAMPLES 20
+#define DEFAULT_BATCH_SIZE 1000
+// task system construction is far slower than the other operations
+#define CONSTRUCTION_BATCH_DIVISOR 20
+
+void usage(const char* progname) {
+    printf("Usage: %s [options] [benchmark]\n", progname);
+    printf("Program Options:\n");
+    printf("  -n  --num_threads <INT>       Number of threads: <INT> (default=%d)\n", DEFAULT_NUM_THREADS);
+    printf("  -r  --samples <INT>           Timed samples per benchmark (default=%d)\n", DEFAULT_NUM_SAMPLES);
+    printf("  -b  --batch <INT>             Operations per sample (default=%d)\n", DEFAULT_BATCH_SIZE);
+    printf("  -f  --format <text|json|csv>  Output format (default=text)\n");
+    printf("  -?  --help                    This message\n");
+    printf("Runs every benchmark unless one is named.\n");
+}
+
+enum TaskSystemType {
+    SERIAL,
+    PARALLEL_SPAWN,
+    PARALLEL_THREAD_POOL_SPINNING,
+    PARALLEL_THREAD_POOL_SLEEPING,
+    N_TASKSYS_IMPLS, // This must be in the last position.
+};
+
+ITaskSystem *selectTaskSystemRefImpl(int num_threads, TaskSystemType type) {
+    assert(type < N_TASKSYS_IMPLS);
+
+    if (type == SERIAL) {
+        return new TaskSystemSerial(num_threads);
+    } else if (type == PARALLEL_SPAWN) {
+        return new TaskSystemParallelSpawn(num_threads);
+    } else if (type == PARALLEL_THREAD_POOL_SPINNING) {
+        return new TaskSystemParallelThreadPoolSpinning(num_threads);
+    } else if (type == PARALLEL_THREAD_POOL_SLEEPING) {
+        return new TaskSystemParallelThreadPoolSleeping(num_threads);
+    } else {
+        return NULL;
+    }
+}
+
+class EmptyTask : public IRunnable {
+    public:
+        void runTask(int task_id, int num_total_tasks) {}
+};
+
+/*
+ * A benchmark performs `ops` operations and returns the time they took
+ * in seconds.  `t` is a task system of implementation `type` shared by
+ * all samples of the benchmark.
+ */
+typedef double (*Benchmark)(ITaskSystem *t, TaskSystemType type, int num_threads, int ops);
+
+// run() of a single empty task
+double emptyRunBench(ITaskSystem *t, TaskSystemType type, int num_threads, int ops) {
+    EmptyTask task;
+    double start = CycleTimer::currentSeconds();
+    for (int i = 0; i < ops; i++) {
+        t->run(&task, 1);
+    }
+    return CycleTimer::currentSeconds() - start;
+}
+
+// run() of one empty task per thread
+double emptyRunWideBench(ITaskSystem *t, TaskSystemType type, int num_threads, int ops) {
+    EmptyTask task;
+    double start = CycleTimer::currentSeconds();
+    for (int i = 0; i < ops; i++) {
+        t->run(&task, num_threads);
+    }
+    return CycleTimer::currentSeconds() - start;
+}
+
+// chain of single-task launches, each depending on the previous one
+double dependentChainBench(ITaskSystem *t, TaskSystemType type, int num_threads, int ops) {
+    EmptyTask task;
+    std::vector<TaskID> deps;
+    double start = CycleTimer::currentSeconds();
+    for (int i = 0; i < ops; i++) {
+        TaskID id = t->runAsyncWithDeps(&task, 1, deps);
+        deps.assign(1, id);
+    }
+    t->sync();
+    return CycleTimer::currentSeconds() - start;
+}
+
+// runAsyncWithDeps() calls alone; the launches are drained untimed
+double asyncSubmitBench(ITaskSystem *t, TaskSystemType type, int num_threads, int ops) {
+    EmptyTask task;
+    std::vector<TaskID> deps;
+    double start = CycleTimer::currentSeconds();
+    for (int i = 0; i < ops; i++) {
+        t->runAsyncWithDeps(&task, 1, deps);
+    }
+    double elapsed = CycleTimer::currentSeconds() - start;
+    t->sync();
+    return elapsed;
+}
+
+// sync() with no launch outstanding
+double idleSyncBench(ITaskSystem *t, TaskSystemType type, int num_threads, int ops) {
+    t->sync();
+    double start = CycleTimer::currentSeconds();
+    for (int i = 0; i < ops; i++) {
+        t->sync();
+    }
+    return CycleTimer::currentSeconds() - start;
+}
+
+// constructing and destroying a task system
+double createDestroyBench(ITaskSystem *t, TaskSystemType type, int num_threads, int ops) {
+    double start = CycleTimer::currentSeconds();
+    for (int i = 0; i < ops; i++) {
+        delete selectTaskSystemRefImpl(num_threads, type);
+    }
+    return CycleTimer::currentSeconds() - start;
+}
+
+typedef struct {
+    const char *name;
+    Benchmark bench;
+    // operations per sample are divided by this
+    int batch_divisor;
+} BenchmarkInfo;
+
+static const BenchmarkInfo BENCHMARKS[] = {
+    { "empty_run",           emptyRunBench,       1 },
+    { "empty_run_wide",      emptyRunWideBench,   1 },
+    { "dependent_chain",     dependentChainBench, 1 },
+    { "async_submit",        asyncSubmitBench,    1 },
+    { "idle_sync",           idleSyncBench,       1 },
+    { "create_destroy",      createDestroyBench,  CONSTRUCTION_BATCH_DIVISOR },
+};
+
+int main(int argc, char** argv)
+{
+    const int n_benchmarks = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+    int num_threads = DEFAULT_NUM_THREADS;
+    int num_samples = DEFAULT_NUM_SAMPLES;
+    int batch_size = DEFAULT_BATCH_SIZE;
+    ReportFormat format = FORMAT_TEXT;
+
+    int opt;
+    static struct option long_options[] = {
+        {"num_threads", 1, 0,  'n'},
+        {"samples",     1, 0,  'r'},
+        {"batch",       1, 0,  'b'},
+        {"format",      1, 0,  'f'},
+        {"help",        0, 0,  '?'},
+        {0,             0, 0,  0},
+    };
+
+    while ((opt = getopt_long(argc, argv, "n:r:b:f:?", long_options, NULL)) != EOF) {
+        switch (opt) {
+        case 'n':
+            num_threads = atoi(optarg);
+            break;
+        case 'r':
+            num_samples = atoi(optarg);
+            break;
+        case 'b':
+            batch_size = atoi(optarg);
+            break;
+        case 'f':
+            if (!parseReportFormat(optarg, &format)) {
+                fprintf(stderr, "Error: invalid format %s!\n", optarg);
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case '?':
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const char *only = optind < argc ? argv[optind] : NULL;
+    bool text = format == FORMAT_TEXT;
+    Report report(format);
+    report.begin();
+
+    CycleTimer::SelfTestResult timer = CycleTimer::selfTest();
+    double timer_cost = timer.overhead_ns * 1e-9;
+    if (text) {
+        printf("Timer: %s, %.2f ns per tick, %.0f ns resolution, %.0f ns per call\n",
+               timer.source, timer.tick_ns, timer.resolution_ns, timer.overhead_ns);
+    }
+
+    bool found = false;
+    for (int b = 0; b < n_benchmarks; b++) {
+        const BenchmarkInfo &info = BENCHMARKS[b];
+        if (only && strcmp(only, info.name) != 0) {
+            continue;
+        }
+        found = true;
+        int ops = std::max(1, batch_size / info.batch_divisor);
+
+        if (text) {
+            printf("============================================================="
+                   "======================\n");
+            printf("Benchmark: %s (%d ops x %d samples)\n", info.name, ops, num_samples);
+            printf("============================================================="
+                   "======================\n");
+        }
+
+        for (int i = 0; i < N_TASKSYS_IMPLS; i++) {
+            ITaskSystem *t = selectTaskSystemRefImpl(num_threads, (TaskSystemType) i);
+
+            // warm up caches, the allocator and the pool's threads
+            info.bench(t, (TaskSystemType) i, num_threads, ops);
+
+            std::vector<double> per_op;
+            for (int s = 0; s < num_samples; s++) {
+                double elapsed = info.bench(t, (TaskSystemType) i, num_threads, ops);
+                per_op.push_back(std::max(0.0, elapsed - timer_cost) / ops);
+            }
+            report.add(info.name, t->name(), num_threads, per_op);
+
+            if (text) {
+                TimingSummary summary = summarizeTimings(per_op);
+                printf("[%s]:\t\t[median %.0f ns] mean %.0f ns +- %.0f ns (95%% CI), min %.0f ns\n",
+                       t->name(), summary.median * 1e9, summary.mean * 1e9,
+                       (summary.ci95_high - summary.mean) * 1e9, summary.min * 1e9);
+            }
+            delete t;
+        }
+    }
+    if (text && found) {
+        printf("============================================================="
+               "======================\n");
+    }
+    if (!found) {
+        fprintf(stderr, "Error: invalid benchmark %s!\n", only);
+        usage(argv[0]);
+        return 1;
+    }
+    report.end();
+
+    return 0;
+}
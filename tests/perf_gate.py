@@ -0,0 +1,190 @@
+"""Performance regression gate for runtasks.
+
+Records per-iteration timings from `runtasks --format=json` into a JSON
+baseline keyed by test, implementation and thread count, and compares
+later runs against it.  A comparison flags a regression only when a
+one-sided Mann-Whitney U test finds the new timings significantly
+slower than the baseline timings inflated by the allowed margin, so a
+single noisy iteration does not fail the gate the way a ratio of
+minimums would.
+
+  python3 perf_gate.py record  -b baseline.json -t ping_pong_equal mandelbrot_chunked
+  python3 perf_gate.py compare -b baseline.json -t ping_pong_equal mandelbrot_chunked
+
+Both commands can read existing runtasks JSON reports with --input
+instead of running the binary.  compare exits with status 1 if any
+regression is found.
+"""
+
+import argparse
+import json
+import math
+import statistics
+import subprocess
+import sys
+
+DEFAULT_BINARY = "./runtasks"
+DEFAULT_BASELINE = "perf_baseline.json"
+DEFAULT_ITERATIONS = 10
+DEFAULT_MARGIN = 0.05
+DEFAULT_ALPHA = 0.01
+# differences below timer noise are never reported
+DEFAULT_MIN_DELTA_MS = 0.01
+
+
+def result_key(result):
+    return "%s|%s|%d" % (result["test"], result["impl"], result["num_threads"])
+
+
+def run_binary(binary, test_name, num_threads, iterations):
+    cmd = [binary, "--format=json", "-n", str(num_threads), "-i", str(iterations), test_name]
+    output = subprocess.check_output(cmd).decode("utf-8")
+    return json.loads(output)
+
+
+def collect_reports(args):
+    """Returns runtasks JSON reports, either read from --input or produced
+    by running every requested test at every requested thread count."""
+    if args.input:
+        reports = []
+        for path in args.input:
+            with open(path) as f:
+                reports.append(json.load(f))
+        return reports
+    reports = []
+    for test_name in args.test_names:
+        for num_threads in args.num_threads:
+            print("Running %s with %d threads..." % (test_name, num_threads), file=sys.stderr)
+            reports.append(run_binary(args.binary, test_name, num_threads, args.iterations))
+    return reports
+
+
+def mann_whitney_greater(xs, ys):
+    """One-sided Mann-Whitney U test of H1: values in xs tend to be larger
+    than values in ys.  Uses the normal approximation with tie and
+    continuity corrections and returns the p-value."""
+    n1, n2 = len(xs), len(ys)
+    if n1 == 0 or n2 == 0:
+        return 1.0
+    pooled = sorted([(x, 0) for x in xs] + [(y, 1) for y in ys])
+    ranks = [0.0] * len(pooled)
+    tie_term = 0.0
+    i = 0
+    while i < len(pooled):
+        j = i
+        while j + 1 < len(pooled) and pooled[j + 1][0] == pooled[i][0]:
+            j += 1
+        # average rank of the tied block i..j (ranks are 1-based)
+        for k in range(i, j + 1):
+            ranks[k] = (i + j) / 2.0 + 1
+        t = j - i + 1
+        tie_term += t ** 3 - t
+        i = j + 1
+    rank_sum = sum(r for r, (_, group) in zip(ranks, pooled) if group == 0)
+    u = rank_sum - n1 * (n1 + 1) / 2.0
+    n = n1 + n2
+    mean = n1 * n2 / 2.0
+    variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)))
+    if variance <= 0:
+        return 1.0
+    z = (u - mean - 0.5) / math.sqrt(variance)
+    return 1.0 - statistics.NormalDist().cdf(z)
+
+
+def record(args):
+    try:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    except FileNotFoundError:
+        baseline = {"results": {}}
+
+    for report in collect_reports(args):
+        baseline["git_revision"] = report["git_revision"]
+        baseline["host"] = report["host"]
+        for result in report["results"]:
+            baseline["results"][result_key(result)] = {
+                "test": result["test"],
+                "impl": result["impl"],
+                "num_threads": result["num_threads"],
+                "times_ms": result["times_ms"],
+            }
+
+    with open(args.baseline, "w") as f:
+        json.dump(baseline, f, indent=2, sort_keys=True)
+    print("Recorded %d results in %s" % (len(baseline["results"]), args.baseline))
+    return 0
+
+
+def compare(args):
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    rows = []
+    regressions = 0
+    for report in collect_reports(args):
+        if report["host"] != baseline.get("host"):
+            print("Warning: baseline was recorded on a different host", file=sys.stderr)
+        for result in report["results"]:
+            key = result_key(result)
+            current = result["times_ms"]
+            name = "%s [%s] x%d" % (result["test"], result["impl"], result["num_threads"])
+            if key not in baseline["results"]:
+                rows.append((name, None, statistics.median(current), None, None, "NO BASELINE"))
+                continue
+            base = baseline["results"][key]["times_ms"]
+            allowed = [t * (1 + args.margin) for t in base]
+            p_slower = mann_whitney_greater(current, allowed)
+            p_faster = mann_whitney_greater(base, current)
+            base_median = statistics.median(base)
+            current_median = statistics.median(current)
+            change = (current_median / base_median - 1) * 100 if base_median > 0 else 0.0
+            significant = abs(current_median - base_median) >= args.min_delta_ms
+            if p_slower < args.alpha and significant:
+                verdict = "REGRESSION"
+                regressions += 1
+            elif p_faster < args.alpha and significant:
+                verdict = "faster"
+            else:
+                verdict = "ok"
+            rows.append((name, base_median, current_median, change, p_slower, verdict))
+
+    print("%-64s %12s %12s %8s %8s  %s" % ("test [impl] xthreads", "base_ms",
+                                          "new_ms", "change", "p", "verdict"))
+    for name, base_median, current_median, change, p, verdict in rows:
+        if base_median is None:
+            print("%-64s %12s %12.3f %8s %8s  %s" % (name, "-", current_median, "-", "-", verdict))
+        else:
+            print("%-64s %12.3f %12.3f %+7.1f%% %8.4f  %s" % (name, base_median, current_median,
+                                                            change, p, verdict))
+    print("%d regression(s) beyond a %.0f%% margin at alpha=%g (baseline %s)" % (
+        regressions, args.margin * 100, args.alpha, baseline.get("git_revision", "unknown")))
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Record and check runtasks performance baselines')
+    parser.add_argument('command', choices=['record', 'compare'])
+    parser.add_argument('-b', '--baseline', default=DEFAULT_BASELINE,
+                        help="Baseline file (%s by default)" % DEFAULT_BASELINE)
+    parser.add_argument('--binary', default=DEFAULT_BINARY,
+                        help="runtasks binary to run (%s by default)" % DEFAULT_BINARY)
+    parser.add_argument('-t', '--test_names', type=str, nargs='+', default=[],
+                        help='Tests to run')
+    parser.add_argument('-n', '--num_threads', type=int, nargs='+', default=[8],
+                        help='Thread counts to run each test with (8 by default)')
+    parser.add_argument('-i', '--iterations', type=int, default=DEFAULT_ITERATIONS,
+                        help='Timed iterations per test (%d by default)' % DEFAULT_ITERATIONS)
+    parser.add_argument('--input', type=str, nargs='+',
+                        help='Read runtasks --format=json reports instead of running tests')
+    parser.add_argument('--margin', type=float, default=DEFAULT_MARGIN,
+                        help='Allowed slowdown before a difference counts (%.2f by default)' % DEFAULT_MARGIN)
+    parser.add_argument('--alpha', type=float, default=DEFAULT_ALPHA,
+                        help='Significance level of the test (%g by default)' % DEFAULT_ALPHA)
+    parser.add_argument('--min_delta_ms', type=float, default=DEFAULT_MIN_DELTA_MS,
+                        help='Ignore median differences below this (%g ms by default)' % DEFAULT_MIN_DELTA_MS)
+    args = parser.parse_args()
+
+    if not args.input and not args.test_names:
+        parser.error("either --test_names or --input is required")
+
+    sys.exit(record(args) if args.command == 'record' else compare(args))
@@ -0,0 +1,266 @@
+#ifndef _REPORT_H
+#define _REPORT_H
+
+/*
+ * Machine-readable benchmark reports for the runtasks drivers.  A
+ * report holds one record per (test, implementation, thread count)
+ * with every timed iteration and its summary statistics, preceded by
+ * the git revision the binary was built from and a description of the
+ * host, so that results from different machines and builds can be
+ * compared later.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+// set by the Makefile from `git describe`
+#ifndef GIT_REVISION
+#define GIT_REVISION "unknown"
+#endif
+
+enum ReportFormat {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_CSV,
+};
+
+bool parseReportFormat(const char *name, ReportFormat *format) {
+    if (strcmp(name, "text") == 0) {
+        *format = FORMAT_TEXT;
+    } else if (strcmp(name, "json") == 0) {
+        *format = FORMAT_JSON;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = FORMAT_CSV;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Summary statistics of a set of timings, in the unit of the timings.
+ * The confidence interval is the two-sided 95% Student t interval of
+ * the mean; it is empty (low == high == mean) for a single timing.
+ */
+typedef struct {
+    double mean;
+    double median;
+    double stddev;
+    double min;
+    double max;
+    double ci95_low;
+    double ci95_high;
+} TimingSummary;
+
+// two-sided 95% critical values of Student's t for 1..30 degrees of freedom
+static const double T_CRITICAL_95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+TimingSummary summarizeTimings(const std::vector<double> &times) {
+    TimingSummary s = {};
+    size_t n = times.size();
+    if (n == 0) {
+        return s;
+    }
+    std::vector<double> sorted(times);
+    std::sort(sorted.begin(), sorted.end());
+    s.min = sorted.front();
+    s.max = sorted.back();
+    s.median = (n % 2 == 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += times[i];
+    }
+    s.mean = sum / n;
+    double squares = 0;
+    for (size_t i = 0; i < n; i++) {
+        squares += (times[i] - s.mean) * (times[i] - s.mean);
+    }
+    s.stddev = n > 1 ? sqrt(squares / (n - 1)) : 0;
+    double t = n > 31 ? 1.960 : (n > 1 ? T_CRITICAL_95[n - 2] : 0);
+    double half_width = t * s.stddev / sqrt((double) n);
+    s.ci95_low = s.mean - half_width;
+    s.ci95_high = s.mean + half_width;
+    return s;
+}
+
+typedef struct {
+    std::string os;
+    std::string hostname;
+    std::string machine;
+    std::string cpu;
+    int hardware_threads;
+} HostInfo;
+
+HostInfo hostInfo() {
+    HostInfo host;
+    struct utsname name;
+    if (uname(&name) == 0) {
+        host.os = std::string(name.sysname) + " " + name.release;
+        host.hostname = name.nodename;
+        host.machine = name.machine;
+    }
+    host.cpu = "unknown";
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    if (fp) {
+        char line[512];
+        while (fgets(line, sizeof(line), fp)) {
+            // "model name" on x86, "CPU part" is all aarch64 offers
+            if (strncmp(line, "model name", 10) == 0) {
+                char *value = strchr(line, ':');
+                if (value) {
+                    host.cpu = value + 2;
+                    host.cpu.erase(host.cpu.find_last_not_of(" \n") + 1);
+                }
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    host.hardware_threads = std::thread::hardware_concurrency();
+    return host;
+}
+
+/*
+ * Writes the records of a report to stdout as they are added.  Text
+ * reports print nothing here: the drivers print their usual
+ * human-readable output instead.  JSON and CSV reports keep stdout to
+ * themselves: begin() moves everything else the program prints to
+ * stdout (test diagnostics, correctness failures) over to stderr, so
+ * the report stays parseable.
+ */
+class Report {
+    private:
+        ReportFormat format;
+        HostInfo host;
+        int records;
+        // the original stdout
+        FILE *out;
+
+        static std::string jsonString(const std::string &s) {
+            std::string out = "\"";
+            for (size_t i = 0; i < s.size(); i++) {
+                unsigned char c = s[i];
+                if (c < 0x20) {
+                    // control characters may not appear raw in a JSON string
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    out += escape;
+                    continue;
+                }
+                if (c == '"' || c == '\\') out += '\\';
+                out += s[i];
+            }
+            return out + "\"";
+        }
+
+        static std::string csvField(const std::string &s) {
+            if (s.find_first_of(",\"\n") == std::string::npos) return s;
+            std::string out = "\"";
+            for (size_t i = 0; i < s.size(); i++) {
+                if (s[i] == '"') out += '"';
+                out += s[i];
+            }
+            return out + "\"";
+        }
+
+    public:
+        Report(ReportFormat format) : format(format), records(0), out(stdout) {
+            host = hostInfo();
+        }
+
+        ReportFormat getFormat() {
+            return format;
+        }
+
+        void begin() {
+            if (format != FORMAT_TEXT) {
+                fflush(stdout);
+                int fd = dup(STDOUT_FILENO);
+                FILE *fp = fd == -1 ? NULL : fdopen(fd, "w");
+                if (fp) {
+                    out = fp;
+                    dup2(STDERR_FILENO, STDOUT_FILENO);
+                }
+            }
+            if (format == FORMAT_JSON) {
+                fprintf(out, "{\n");
+                fprintf(out, "  \"git_revision\": %s,\n", jsonString(GIT_REVISION).c_str());
+                fprintf(out, "  \"host\": {\"os\": %s, \"hostname\": %s, \"machine\": %s, "
+                            "\"cpu\": %s, \"hardware_threads\": %d},\n",
+                            jsonString(host.os).c_str(), jsonString(host.hostname).c_str(),
+                            jsonString(host.machine).c_str(), jsonString(host.cpu).c_str(),
+                            host.hardware_threads);
+                fprintf(out, "  \"results\": [");
+            } else if (format == FORMAT_CSV) {
+                fprintf(out, "test,impl,num_threads,iterations,mean_ms,median_ms,stddev_ms,"
+                            "min_ms,max_ms,ci95_low_ms,ci95_high_ms,times_ms,gb_per_s,git_revision,"
+                            "os,hostname,machine,cpu,hardware_threads\n");
+            }
+        }
+
+        // times are in seconds; bandwidth tests pass the bytes moved per
+        // run and are reported in GB/s at the median time
+        void add(const std::string &test, const std::string &impl, int num_threads,
+                 const std::vector<double> &times, double bytes = 0) {
+            TimingSummary s = summarizeTimings(times);
+            double gb_per_s = bytes > 0 && s.median > 0 ? bytes / s.median * 1e-9 : 0;
+            if (format == FORMAT_JSON) {
+                fprintf(out, "%s\n    {\"test\": %s, \"impl\": %s, \"num_threads\": %d, "
+                            "\"iterations\": %d,\n     \"times_ms\": [",
+                            records ? "," : "", jsonString(test).c_str(),
+                            jsonString(impl).c_str(), num_threads, (int) times.size());
+                for (size_t i = 0; i < times.size(); i++) {
+                    fprintf(out, "%s%.6f", i ? ", " : "", times[i] * 1000);
+                }
+                fprintf(out, "],\n     \"mean_ms\": %.6f, \"median_ms\": %.6f, \"stddev_ms\": %.6f, "
+                            "\"min_ms\": %.6f, \"max_ms\": %.6f,\n"
+                            "     \"ci95_low_ms\": %.6f, \"ci95_high_ms\": %.6f",
+                            s.mean * 1000, s.median * 1000, s.stddev * 1000, s.min * 1000,
+                            s.max * 1000, s.ci95_low * 1000, s.ci95_high * 1000);
+                if (bytes > 0) {
+                    fprintf(out, ", \"bytes\": %.0f, \"gb_per_s\": %.3f", bytes, gb_per_s);
+                }
+                fprintf(out, "}");
+            } else if (format == FORMAT_CSV) {
+                fprintf(out, "%s,%s,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,",
+                            csvField(test).c_str(), csvField(impl).c_str(), num_threads,
+                            (int) times.size(), s.mean * 1000, s.median * 1000, s.stddev * 1000,
+                            s.min * 1000, s.max * 1000, s.ci95_low * 1000, s.ci95_high * 1000);
+                // iterations separated by ';' to keep one record per line
+                for (size_t i = 0; i < times.size(); i++) {
+                    fprintf(out, "%s%.6f", i ? ";" : "", times[i] * 1000);
+                }
+                if (bytes > 0) {
+                    fprintf(out, ",%.3f", gb_per_s);
+                } else {
+                    fprintf(out, ",");
+                }
+                fprintf(out, ",%s,%s,%s,%s,%s,%d\n", csvField(GIT_REVISION).c_str(),
+                            csvField(host.os).c_str(), csvField(host.hostname).c_str(),
+                            csvField(host.machine).c_str(), csvField(host.cpu).c_str(),
+                            host.hardware_threads);
+            }
+            records++;
+            fflush(out);
+        }
+
+        void end() {
+            if (format == FORMAT_JSON) {
+                fprintf(out, "\n  ]\n}\n");
+            }
+            fflush(out);
+        }
+};
+
+#endif
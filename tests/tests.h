@@ -9,6 +9,11 @@
 
 #include "CycleTimer.h"
 #include "itasksys.h"
+#include "parallel.h"
+#include "dag.h"
+#include "mandel_simd.h"
+#include "ppm.h"
+#include "alloc_count.h"
 
 /*
 Sync tests
@@ -17,12 +22,26 @@ TestResults pingPongEqualTest(ITaskSystem *t);
 TestResults pingPongUnequalTest(ITaskSystem *t);
 TestResults superLightTest(ITaskSystem *t);
 TestResults superSuperLightTest(ITaskSystem *t);
+TestResults superSuperLightParallelForTest(ITaskSystem *t);
 TestResults recursiveFibonacciTest(ITaskSystem* t);
 TestResults mathOperationsInTightForLoopTest(ITaskSystem* t);
 TestResults mathOperationsInTightForLoopFanInTest(ITaskSystem* t);
 TestResults mathOperationsInTightForLoopReductionTreeTest(ITaskSystem* t);
+TestResults parallelReduceTest(ITaskSystem* t);
+TestResults parallelReduceDeterministicTest(ITaskSystem* t);
+TestResults parallelScan1MTest(ITaskSystem* t);
+TestResults parallelScan16MTest(ITaskSystem* t);
+TestResults parallelExclusiveScan16MTest(ITaskSystem* t);
+TestResults serialScan1MTest(ITaskSystem* t);
+TestResults serialScan16MTest(ITaskSystem* t);
 TestResults spinBetweenRunCallsTest(ITaskSystem *t);
+TestResults largeRunAfterSmallTest(ITaskSystem *t);
 TestResults mandelbrotChunkedTest(ITaskSystem* t);
+TestResults mandelbrotChunkedSimdTest(ITaskSystem* t);
+TestResults mandelbrotTiledTest(ITaskSystem* t);
+TestResults mandelbrotTiledMortonTest(ITaskSystem* t);
+TestResults mandelbrotTiledHilbertTest(ITaskSystem* t);
+TestResults mandelbrotTiledSmallHilbertTest(ITaskSystem* t);
 
 Async with dependencies tests
 =============================
@@ -30,13 +49,42 @@ TestResults pingPongEqualAsyncTest(ITaskSystem *t);
 TestResults pingPongUnequalAsyncTest(ITaskSystem *t);
 TestResults superLightAsyncTest(ITaskSystem *t);
 TestResults superSuperLightAsyncTest(ITaskSystem *t);
+TestResults superSuperLightParallelForAsyncTest(ITaskSystem *t);
 TestResults recursiveFibonacciAsyncTest(ITaskSystem* t);
 TestResults mathOperationsInTightForLoopAsyncTest(ITaskSystem* t);
 TestResults mathOperationsInTightForLoopFanInAsyncTest(ITaskSystem* t);
 TestResults mathOperationsInTightForLoopReductionTreeAsyncTest(ITaskSystem* t);
 TestResults spinBetweenRunCallsAsyncTest(ITaskSystem *t);
+TestResults tinyRunsBetweenAsyncTest(ITaskSystem *t);
 TestResults mandelbrotChunkedAsyncTest(ITaskSystem* t);
+TestResults mandelbrotChunkedSimdAsyncTest(ITaskSystem* t);
+TestResults mandelbrotTiledHilbertAsyncTest(ITaskSystem* t);
 TestResults simpleRunDepsTest(ITaskSystem *t);
+TestResults continuationTest(ITaskSystem *t);
+TestResults steadyStateAllocationsTest(ITaskSystem *t);
+TestResults dagChainTest(ITaskSystem *t);
+TestResults dagFanOutFanInTest(ITaskSystem *t);
+TestResults dagBinaryTreeTest(ITaskSystem *t);
+TestResults dagLayeredTest(ITaskSystem *t);
+TestResults dagSeriesParallelTest(ITaskSystem *t);
+TestResults dagRandomTest(ITaskSystem *t);
+TestResults dagRandom1MTest(ITaskSystem *t);
+
+Memory bandwidth tests (sync and async)
+=======================================
+TestResults streamTriadTest(ITaskSystem *t);
+TestResults streamTriadAsyncTest(ITaskSystem *t);
+TestResults jacobi2DTest(ITaskSystem *t);
+TestResults jacobi2DAsyncTest(ITaskSystem *t);
+TestResults jacobi3DTest(ITaskSystem *t);
+TestResults jacobi3DAsyncTest(ITaskSystem *t);
+TestResults gatherScatterTest(ITaskSystem *t);
+TestResults gatherScatterAsyncTest(ITaskSystem *t);
+
+Image output tests
+==================
+TestResults ppmWriteTest(ITaskSystem *t);
+TestResults ppmWriteMmapTest(ITaskSystem *t);
 */
 
 /*
@@ -45,6 +93,12 @@ TestResults simpleRunDepsTest(ITaskSystem *t);
 typedef struct {
     bool passed;
     double time;
+    // bytes of memory traffic the test is designed to move, or 0 if it
+    // is not a bandwidth test
+    double bytes = 0;
+    // print the bandwidth in MB/s rather than GB/s, for tests bound by
+    // file I/O rather than memory
+    bool report_mb = false;
 } TestResults;
 
 /*
@@ -149,6 +203,16 @@ class SimpleMultiplyTask : public IRunnable {
             for (int i=start_el; i<end_el; i++)
                 array_[i] = multiply_task(3, array_[i]);
         }
+
+        void runTaskRange(int begin, int end, int num_total_tasks) {
+            // tasks [begin, end) cover one contiguous run of elements
+            int elements_per_task = (num_elements_ + num_total_tasks-1) / num_total_tasks;
+            int start_el = std::min(elements_per_task * begin, num_elements_);
+            int end_el = std::min(elements_per_task * end, num_elements_);
+
+            for (int i=start_el; i<end_el; i++)
+                array_[i] = multiply_task(3, array_[i]);
+        }
 };
 
 /*
@@ -241,6 +305,34 @@ class LightTask: public IRunnable {
         }
 };
 
+// counts the tasks it ran and does nothing else
+class CountTask : public IRunnable {
+    public:
+        std::atomic<long long> tasks_run;
+        CountTask() : tasks_run(0) {}
+        ~CountTask() {}
+        void runTask(int task_id, int num_total_tasks) {
+            tasks_run++;
+        }
+};
+
+/*
+ * Each task busy-waits for the given number of seconds.
+ */
+class SpinTask: public IRunnable {
+    public:
+        double seconds_;
+        std::atomic<long long> tasks_run;
+        SpinTask(double seconds) : seconds_(seconds), tasks_run(0) {}
+        ~SpinTask() {}
+
+        void runTask(int task_id, int num_total_tasks) {
+            double end = CycleTimer::currentSeconds() + seconds_;
+            while (CycleTimer::currentSeconds() < end) {}
+            tasks_run++;
+        }
+};
+
 /*
  * Each task performs a sequence of exp, log, and multiplication
  * operations in a tight for loop.
@@ -256,9 +348,15 @@ class MathOperationsInTightForLoopTask: public IRunnable {
         ~MathOperationsInTightForLoopTask() {}
 
         void runTask(int task_id, int num_total_tasks) {
+            runTaskRange(task_id, task_id + 1, num_total_tasks);
+        }
+
+        void runTaskRange(int begin, int end_task, int num_total_tasks) {
+            // tasks [begin, end_task) cover one contiguous run of elements;
+            // the last task also takes the remainder of the array
             int elements_per_task = array_size_ / num_total_tasks;
-            int start = task_id * elements_per_task;
-            int end = std::min(start + elements_per_task, array_size_);
+            int start = begin * elements_per_task;
+            int end = std::min(end_task * elements_per_task, array_size_);
             if (array_size_ - end < elements_per_task) {
                 end = array_size_;
             }
@@ -328,12 +426,18 @@ class MandelbrotTask: public IRunnable {
 
         MandelArgs *args_;
 		int interleave_;
+        // vectorized kernel for whole lane groups of a row, see mandel_simd.h
+        MandelRowKernel simd_;
 
-        MandelbrotTask(MandelArgs *args, int interleave) 
-          : args_(args), interleave_(interleave) {}
+        MandelbrotTask(MandelArgs *args, int interleave, bool simd = false)
+          : args_(args), interleave_(interleave),
+            simd_(simd ? mandelRowKernel() : NULL) {}
         ~MandelbrotTask() {}
 
-        // helper function used by Mandelbrot computations
+        // helper function used by Mandelbrot computations.  It and its
+        // callers are not contracted, so that it matches the kernels of
+        // mandel_simd.h bit for bit and still inlines into the loops.
+        MANDEL_NO_FP_CONTRACT
         inline int mandel(float c_re, float c_im, int count) {
             float z_re = c_re, z_im = c_im;
             int i;
@@ -351,6 +455,7 @@ class MandelbrotTask: public IRunnable {
             return i;
         }
 
+        MANDEL_NO_FP_CONTRACT
         void mandelbrotSerial(
             float x0, float y0, float x1, float y1,
             int width, int height,
@@ -364,7 +469,12 @@ class MandelbrotTask: public IRunnable {
             int endRow = startRow + totalRows;
 
             for (int j = startRow; j < endRow; j++) {
-                for (int i = 0; i < width; ++i) {
+                int start = 0;
+                if (simd_) {
+                    start = simd_(x0, dx, y0 + j * dy, width, max_iterations,
+                                  output + j * width);
+                }
+                for (int i = start; i < width; ++i) {
                     float x = x0 + i * dx;
                     float y = y0 + j * dy;
 
@@ -374,6 +484,7 @@ class MandelbrotTask: public IRunnable {
             }
         }
 
+        MANDEL_NO_FP_CONTRACT
         void mandelbrotSerial_interleaved(
             float x0, float y0, float x1, float y1,
             int width, int height,
@@ -387,7 +498,12 @@ class MandelbrotTask: public IRunnable {
             int endRow = startRow + totalRows;
 
             for (int j = startRow; j < endRow; j += interleaving) {
-                for (int i = 0; i < width; ++i) {
+                int start = 0;
+                if (simd_) {
+                    start = simd_(x0, dx, y0 + j * dy, width, max_iterations,
+                                  output + j * width);
+                }
+                for (int i = start; i < width; ++i) {
                     float x = x0 + i * dx;
                     float y = y0 + j * dy;
 
@@ -396,6 +512,23 @@ class MandelbrotTask: public IRunnable {
                 }
             }
         }
+
+        // computes pixels [x_begin, x_end) x [y_begin, y_end) of the image
+        MANDEL_NO_FP_CONTRACT
+        void mandelbrotTile(int x_begin, int x_end, int y_begin, int y_end) {
+            float dx = (args_->x1 - args_->x0) / args_->width;
+            float dy = (args_->y1 - args_->y0) / args_->height;
+
+            for (int j = y_begin; j < y_end; j++) {
+                for (int i = x_begin; i < x_end; ++i) {
+                    float x = args_->x0 + i * dx;
+                    float y = args_->y0 + j * dy;
+
+                    int index = (j * args_->width + i);
+                    args_->output[index] = mandel(x, y, args_->max_iterations);
+                }
+            }
+        }
     
         void runTask(int task_id, int num_total_tasks) {
             int rowsPerTask = args_->height / num_total_tasks;
@@ -481,11 +614,35 @@ class StrictDependencyTask: public IRunnable {
             return true;
         }
 
-        void doWork(int task_id, int num_total_tasks) {
+        virtual void doWork(int task_id, int num_total_tasks) {
             // Using this as a proxy for actual work.
             std::this_thread::sleep_for (std::chrono::microseconds((1 + (task_id % 10))));
         }
-        ~StrictDependencyTask() {}
+        virtual ~StrictDependencyTask() {}
+};
+
+/*
+ * StrictDependencyTask that busy-waits for a per-task cost drawn from
+ * the cost distribution of a synthetic task graph instead of sleeping.
+ */
+class SyntheticDagTask: public StrictDependencyTask {
+    private:
+        const DagSpec &spec_;
+        int launch_;
+
+    public:
+        SyntheticDagTask(const std::vector<bool*>& in_flags, bool *out_flag,
+                         const DagSpec &spec, int launch)
+          : StrictDependencyTask(in_flags, out_flag), spec_(spec), launch_(launch) {}
+
+        void doWork(int task_id, int num_total_tasks) {
+            double cost = dagTaskCost(spec_, launch_, task_id);
+            if (cost <= 0) {
+                return;
+            }
+            double end = CycleTimer::currentSeconds() + cost * 1e-6;
+            while (CycleTimer::currentSeconds() < end) {}
+        }
 };
 
 /* 
@@ -713,6 +870,91 @@ TestResults pingPongUnequalAsyncTest(ITaskSystem* t) {
     return pingPongTest(t, false, true, num_elements, base_iters);
 }
 
+/*
+ * Computation: same as pingPongTest with equal work, but each bulk launch
+ * is a parallel_for() over the elements instead of a PingPongTask. The
+ * element loop is inlined into each chunk, so comparing these tests
+ * against their PingPongTask counterparts shows the cost of the
+ * IRunnable path itself.
+ */
+TestResults pingPongParallelForTest(ITaskSystem* t, bool do_async,
+                                    int num_elements, int base_iters) {
+
+    int num_tasks = 64;
+    int num_bulk_task_launches = 400;
+
+    int* input = new int[num_elements];
+    int* output = new int[num_elements];
+
+    // Init input
+    for (int i=0; i<num_elements; i++) {
+        input[i] = i;
+        output[i] = 0;
+    }
+
+    // Run the test
+    double start_time = CycleTimer::currentSeconds();
+    TaskID prev_task_id = -1;
+    for (int i=0; i<num_bulk_task_launches; i++) {
+        int* in = (i % 2 == 0) ? input : output;
+        int* out = (i % 2 == 0) ? output : input;
+        auto body = [in, out, base_iters](int j) {
+            out[j] = PingPongTask::ping_pong_work(base_iters, in[j]);
+        };
+        if (do_async) {
+            std::vector<TaskID> deps;
+            if (i > 0) {
+                deps.push_back(prev_task_id);
+            }
+            prev_task_id = parallel_for_async(t, num_elements, body, deps, num_tasks);
+        } else {
+            parallel_for(t, num_elements, body, num_tasks);
+        }
+    }
+    if (do_async)
+        t->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    // Correctness validation
+    TestResults results;
+    results.passed = true;
+
+    // Number of ping-pongs determines which buffer to look at for the results
+    int* buffer = (num_bulk_task_launches % 2 == 1) ? output : input;
+
+    for (int i=0; i<num_elements; i++) {
+        int value = i;
+        for (int j=0; j<num_bulk_task_launches; j++) {
+            value = PingPongTask::ping_pong_work(base_iters, value);
+        }
+
+        int expected = value;
+        if (buffer[i] != expected) {
+            results.passed = false;
+            printf("%d: %d expected=%d\n", i, buffer[i], expected);
+            break;
+        }
+    }
+    results.time = end_time - start_time;
+
+    delete [] input;
+    delete [] output;
+
+    return results;
+}
+
+TestResults superSuperLightParallelForTest(ITaskSystem* t) {
+    int num_elements = 32 * 1024;
+    int base_iters = 0;
+    return pingPongParallelForTest(t, false, num_elements, base_iters);
+}
+
+TestResults superSuperLightParallelForAsyncTest(ITaskSystem* t) {
+    int num_elements = 32 * 1024;
+    int base_iters = 0;
+    return pingPongParallelForTest(t, true, num_elements, base_iters);
+}
+
 /*
  * Computation: The following tests compute Fibonacci numbers using
  * recursion. Since the tasks are compute intensive, the tests show
@@ -1096,6 +1338,151 @@ TestResults mathOperationsInTightForLoopReductionTreeAsyncTest(ITaskSystem* t) {
     return mathOperationsInTightForLoopReductionTreeTestBase(t, true);
 }
 
+/*
+ * Computation: The following tests sum 2^24 doubles with parallel_reduce().
+ * The default mode merges per-slot partials whose contents depend on
+ * scheduling, so it is checked against a serial sum with a tolerance.
+ * The deterministic mode combines fixed chunks in a fixed tree order,
+ * so it must match a serial replay of that order exactly.
+ */
+TestResults parallelReduceTestBase(ITaskSystem* t, bool deterministic) {
+
+    int n = 1 << 24;
+    int num_chunks = 64;
+
+    double* input = new double[n];
+    for (int i = 0; i < n; i++) {
+        input[i] = 1.0 / (1 + (i % 1000));
+    }
+
+    auto map = [input](int i) { return input[i]; };
+    auto combine = [](double a, double b) { return a + b; };
+
+    double start_time = CycleTimer::currentSeconds();
+    double sum = parallel_reduce(t, n, 0.0, map, combine, deterministic, num_chunks);
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = true;
+
+    double expected = 0.0;
+    for (int i = 0; i < n; i++) {
+        expected += input[i];
+    }
+    if (std::fabs(sum - expected) > 1e-9 * expected) {
+        printf("sum: %f expected=%f\n", sum, expected);
+        result.passed = false;
+    }
+
+    if (deterministic) {
+        // replay the fixed chunking and tree order serially
+        int elements_per_chunk = (n + num_chunks - 1) / num_chunks;
+        std::vector<double> partials(num_chunks, 0.0);
+        for (int c = 0; c < num_chunks; c++) {
+            int stop = std::min(n, (c + 1) * elements_per_chunk);
+            for (int i = c * elements_per_chunk; i < stop; i++) {
+                partials[c] += input[i];
+            }
+        }
+        for (int stride = 1; stride < num_chunks; stride *= 2) {
+            for (int c = 0; c + stride < num_chunks; c += 2 * stride) {
+                partials[c] += partials[c + stride];
+            }
+        }
+        if (sum != partials[0]) {
+            printf("sum: %.17g expected exactly %.17g\n", sum, partials[0]);
+            result.passed = false;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete [] input;
+
+    return result;
+}
+
+TestResults parallelReduceTest(ITaskSystem* t) {
+    return parallelReduceTestBase(t, false);
+}
+
+TestResults parallelReduceDeterministicTest(ITaskSystem* t) {
+    return parallelReduceTestBase(t, true);
+}
+
+/*
+ * Computation: The following tests compute a prefix sum over `n` 64-bit
+ * integers with parallel_scan(), which makes two bulk launches of 64
+ * blocks (block sums, then block scans). The serial_scan tests time a
+ * plain single-pass loop over the same input without using the task
+ * system, as the baseline to compare against.
+ */
+TestResults parallelScanTestBase(ITaskSystem* t, int n, bool inclusive, bool use_task_system) {
+
+    long long* input = new long long[n];
+    long long* output = new long long[n];
+    for (int i = 0; i < n; i++) {
+        input[i] = i % 7;
+        output[i] = 0;
+    }
+
+    auto add = [](long long a, long long b) { return a + b; };
+
+    double start_time = CycleTimer::currentSeconds();
+    if (use_task_system) {
+        parallel_scan(t, n, input, output, 0LL, add, inclusive);
+    } else {
+        long long acc = 0;
+        for (int i = 0; i < n; i++) {
+            acc += input[i];
+            output[i] = acc;
+        }
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = true;
+    long long expected = 0;
+    for (int i = 0; i < n; i++) {
+        if (inclusive) {
+            expected += input[i];
+        }
+        if (output[i] != expected) {
+            printf("%d: %lld expected=%lld\n", i, output[i], expected);
+            result.passed = false;
+            break;
+        }
+        if (!inclusive) {
+            expected += input[i];
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete [] input;
+    delete [] output;
+
+    return result;
+}
+
+TestResults parallelScan1MTest(ITaskSystem* t) {
+    return parallelScanTestBase(t, 1 << 20, true, true);
+}
+
+TestResults parallelScan16MTest(ITaskSystem* t) {
+    return parallelScanTestBase(t, 1 << 24, true, true);
+}
+
+TestResults parallelExclusiveScan16MTest(ITaskSystem* t) {
+    return parallelScanTestBase(t, 1 << 24, false, true);
+}
+
+TestResults serialScan1MTest(ITaskSystem* t) {
+    return parallelScanTestBase(t, 1 << 20, true, false);
+}
+
+TestResults serialScan16MTest(ITaskSystem* t) {
+    return parallelScanTestBase(t, 1 << 24, true, false);
+}
+
 /*
  * Computation: In between two calls to a light weight task, these tests spawn
  * a medium weight bulk task launch that only has enough enough tasks to
@@ -1170,14 +1557,96 @@ TestResults spinBetweenRunCallsAsyncTest(ITaskSystem *t) {
     return spinBetweenRunCallsTestBase(t, true);
 }
 
+/*
+ * Issues single-task run() calls of one runnable, every other one right
+ * after an asynchronous launch that is still running.  However a task
+ * system executes tiny launches, run() may only return once its own
+ * tasks and every earlier launch have completed.
+ */
+TestResults tinyRunsBetweenAsyncTest(ITaskSystem *t) {
+    const int num_rounds = 256;
+    std::vector<bool*> no_flags;
+    bool *async_done = new bool[num_rounds]();
+    std::vector<IRunnable*> tasks;
+    for (int i = 0; i < num_rounds; i++) {
+        tasks.push_back(new StrictDependencyTask(no_flags, async_done + i));
+    }
+    CountTask run_task;
+
+    TestResults result;
+    result.passed = true;
+    double start_time = CycleTimer::currentSeconds();
+    for (int i = 0; i < num_rounds; i++) {
+        bool pending = i % 2 == 0;
+        if (pending) {
+            t->runAsyncWithDeps(tasks[i], 4, std::vector<TaskID>());
+        }
+        t->run(&run_task, 1);
+        bool run_done = run_task.tasks_run == i + 1;
+        if (!run_done || (pending && !async_done[i])) {
+            printf("run() %d returned before %s launch completed\n", i,
+                   run_done ? "an earlier" : "its own");
+            result.passed = false;
+            break;
+        }
+    }
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+    result.time = end_time - start_time;
+
+    delete[] async_done;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        delete tasks[i];
+    }
+    return result;
+}
+
+/*
+ * Runs many launches of a runnable that does no work, then launches of
+ * the same type and size whose tasks spin for a millisecond, and of a
+ * single such task.  Task systems that run small launches on the
+ * calling thread must not take the expensive ones for small ones: none
+ * of them may be counted in TaskSystemStats::launches_inlined.
+ */
+TestResults largeRunAfterSmallTest(ITaskSystem *t) {
+    const int num_small_runs = 64;
+    const int num_large_runs = 4;
+    const int num_tasks = 32;
+    SpinTask small(0);
+    SpinTask large(1e-3);
+
+    double start_time = CycleTimer::currentSeconds();
+    for (int i = 0; i < num_small_runs; i++) {
+        t->run(&small, num_tasks);
+    }
+    long long inlined = t->getStats().launches_inlined;
+    for (int i = 0; i < num_large_runs; i++) {
+        t->run(&large, num_tasks);
+        t->run(&large, 1);
+    }
+    long long large_inlined = t->getStats().launches_inlined - inlined;
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = small.tasks_run == num_small_runs * num_tasks &&
+                    large.tasks_run == num_large_runs * (num_tasks + 1) &&
+                    large_inlined == 0;
+    if (large_inlined != 0) {
+        printf("%lld expensive launches ran on the calling thread\n", large_inlined);
+    }
+    result.time = end_time - start_time;
+    return result;
+}
+
 /*
  * Computation: This test computes a Mandelbrot fractal image by
  * decomposing the problem into tasks that produce contiguous chunks of
  * output image rows. Note that only one bulk task launch is performed,
  * which means thread pool and spawning threads each run() should have
- * similar performance.
+ * similar performance.  With `simd`, tasks use the vectorized kernel
+ * of mandel_simd.h and must match the scalar image bit for bit.
  */
-TestResults mandelbrotChunkedTestBase(ITaskSystem* t, bool do_async) {
+TestResults mandelbrotChunkedTestBase(ITaskSystem* t, bool do_async, bool simd) {
 
     int num_tasks = 128;
     
@@ -1194,7 +1663,7 @@ TestResults mandelbrotChunkedTestBase(ITaskSystem* t, bool do_async) {
         ma.output[i] = 0;
     }
 
-    MandelbrotTask mandel_task(&ma, true);  // No interleaving
+    MandelbrotTask mandel_task(&ma, true, simd);  // No interleaving
 
     // time task-based implementation
     double start_time = CycleTimer::currentSeconds();
@@ -1210,7 +1679,8 @@ TestResults mandelbrotChunkedTestBase(ITaskSystem* t, bool do_async) {
     // Validate correctness of the task-based implementation
     // against sequential implementation
     int *golden = new int[ma.width * ma.height];
-    mandel_task.mandelbrotSerial(ma.x0, ma.y0, ma.x1, ma.y1,
+    MandelbrotTask scalar_task(&ma, false);
+    scalar_task.mandelbrotSerial(ma.x0, ma.y0, ma.x1, ma.y1,
                                  ma.width, ma.height,
                                  0, ma.height,
                                  ma.max_iterations,
@@ -1233,34 +1703,125 @@ TestResults mandelbrotChunkedTestBase(ITaskSystem* t, bool do_async) {
 }
 
 TestResults mandelbrotChunkedTest(ITaskSystem* t) {
-    return mandelbrotChunkedTestBase(t, false);
+    return mandelbrotChunkedTestBase(t, false, false);
 }
 
 TestResults mandelbrotChunkedAsyncTest(ITaskSystem* t) {
-    return mandelbrotChunkedTestBase(t, true);
+    return mandelbrotChunkedTestBase(t, true, false);
+}
+
+TestResults mandelbrotChunkedSimdTest(ITaskSystem* t) {
+    return mandelbrotChunkedTestBase(t, false, true);
+}
+
+TestResults mandelbrotChunkedSimdAsyncTest(ITaskSystem* t) {
+    return mandelbrotChunkedTestBase(t, true, true);
 }
 
 /*
- * Computation: Simple correctness test for runAsyncWithDeps.
- * Tasks sleep for a prescribed amount of time and then print
- * a message to stdout.
+ * Computation: the same image as mandelbrotChunkedTest, split into
+ * tile_size x tile_size tiles by parallel_for_2d() with one task per
+ * tile, handed out in the given order.  Compared with the row
+ * decomposition, tiles keep each task's pixels close together, and
+ * the much larger number of tasks lets dynamic scheduling even out the
+ * cost of tiles near the boundary of the set.
  */
-TestResults simpleRunDepsTest(ITaskSystem *t) {
-
-    IRunnable* a = new SleepTask(1);
-    IRunnable* b = new SleepTask(5);
-    IRunnable* c = new SleepTask(10);
+TestResults mandelbrotTiledTestBase(ITaskSystem* t, int tile_size, TileOrder order,
+                                    bool do_async) {
+    MandelbrotTask::MandelArgs ma;
+    ma.x0 = -2;
+    ma.x1 = 1;
+    ma.y0 = -1;
+    ma.y1 = 1;
+    ma.width = 1600;
+    ma.height = 1200;
+    ma.max_iterations = 256;
+    ma.output = new int[ma.width * ma.height];
+    for (int i = 0; i < (ma.width * ma.height); i++) {
+        ma.output[i] = 0;
+    }
 
-    std::vector<TaskID> a_deps;
-    std::vector<TaskID> b_deps;
-    std::vector<TaskID> c_deps;
+    MandelbrotTask mandel_task(&ma, false);
+    MandelbrotTask* task = &mandel_task;
+    auto tile = [task](int x_begin, int x_end, int y_begin, int y_end) {
+        task->mandelbrotTile(x_begin, x_end, y_begin, y_end);
+    };
 
-    
     double start_time = CycleTimer::currentSeconds();
-    auto a_taskid = t->runAsyncWithDeps(a, 10, a_deps);
-
-    b_deps.push_back(a_taskid);
-    auto b_task_id = t->runAsyncWithDeps(b, 6, b_deps);
+    if (do_async) {
+        std::vector<TaskID> deps;
+        parallel_for_2d_async(t, ma.width, ma.height, tile_size, tile_size, tile, deps, order);
+        t->sync();
+    } else {
+        parallel_for_2d(t, ma.width, ma.height, tile_size, tile_size, tile, order);
+    }
+    double end_time = CycleTimer::currentSeconds();
+
+    int *golden = new int[ma.width * ma.height];
+    mandel_task.mandelbrotSerial(ma.x0, ma.y0, ma.x1, ma.y1,
+                                 ma.width, ma.height,
+                                 0, ma.height,
+                                 ma.max_iterations,
+                                 golden);
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < ma.width * ma.height; i++) {
+        if (golden[i] != ma.output[i]) {
+            printf("%d: %d expected=%d\n", i, ma.output[i], golden[i]);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete [] golden;
+    delete [] ma.output;
+
+    return result;
+}
+
+TestResults mandelbrotTiledTest(ITaskSystem* t) {
+    return mandelbrotTiledTestBase(t, 32, TILE_ORDER_ROW_MAJOR, false);
+}
+
+TestResults mandelbrotTiledMortonTest(ITaskSystem* t) {
+    return mandelbrotTiledTestBase(t, 32, TILE_ORDER_MORTON, false);
+}
+
+TestResults mandelbrotTiledHilbertTest(ITaskSystem* t) {
+    return mandelbrotTiledTestBase(t, 32, TILE_ORDER_HILBERT, false);
+}
+
+TestResults mandelbrotTiledSmallHilbertTest(ITaskSystem* t) {
+    return mandelbrotTiledTestBase(t, 8, TILE_ORDER_HILBERT, false);
+}
+
+TestResults mandelbrotTiledHilbertAsyncTest(ITaskSystem* t) {
+    return mandelbrotTiledTestBase(t, 32, TILE_ORDER_HILBERT, true);
+}
+
+/*
+ * Computation: Simple correctness test for runAsyncWithDeps.
+ * Tasks sleep for a prescribed amount of time and then print
+ * a message to stdout.
+ */
+TestResults simpleRunDepsTest(ITaskSystem *t) {
+
+    IRunnable* a = new SleepTask(1);
+    IRunnable* b = new SleepTask(5);
+    IRunnable* c = new SleepTask(10);
+
+    std::vector<TaskID> a_deps;
+    std::vector<TaskID> b_deps;
+    std::vector<TaskID> c_deps;
+
+    
+    double start_time = CycleTimer::currentSeconds();
+    auto a_taskid = t->runAsyncWithDeps(a, 10, a_deps);
+
+    b_deps.push_back(a_taskid);
+    auto b_task_id = t->runAsyncWithDeps(b, 6, b_deps);
 
     c_deps.push_back(b_task_id);
     t->runAsyncWithDeps(c, 12, c_deps);
@@ -1333,6 +1894,123 @@ TestResults strictDiamondDepsTest(ITaskSystem *t) {
     return result;
 };
 
+/*
+ * This test chains bulk launches and registers a then() continuation on
+ * each one. A continuation must run before any launch that depends on
+ * its launch starts, and every continuation must have run by the time
+ * sync() returns.
+ */
+TestResults continuationTest(ITaskSystem *t) {
+    int num_launches = 64;
+
+    // done[i] is set by launch i, cont_done[i] by launch i's continuation.
+    bool *done = new bool[num_launches]();
+    bool *cont_done = new bool[num_launches]();
+    std::atomic<int> continuations_run(0);
+
+    std::vector<std::vector<bool*>> flag_deps(num_launches);
+    std::vector<IRunnable*> tasks;
+    for (int i = 0; i < num_launches; i++) {
+        if (i > 0) {
+            flag_deps[i].push_back(cont_done + i - 1);
+        }
+        tasks.push_back(new StrictDependencyTask(flag_deps[i], done + i));
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    TaskID prev_task_id = -1;
+    for (int i = 0; i < num_launches; i++) {
+        std::vector<TaskID> deps;
+        if (i > 0) {
+            deps.push_back(prev_task_id);
+        }
+        prev_task_id = t->runAsyncWithDeps(tasks[i], (i % 8) + 1, deps);
+        bool *flag = cont_done + i;
+        t->then(prev_task_id, [flag, &continuations_run]{
+            *flag = true;
+            continuations_run++;
+        });
+    }
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = done[num_launches-1] && continuations_run == num_launches;
+    for (int i = 0; i < num_launches; i++) {
+        if (!cont_done[i]) {
+            printf("continuation %d did not run before sync()\n", i);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete[] done;
+    delete[] cont_done;
+    for (int i = 0; i < num_launches; i++) {
+        delete tasks[i];
+    }
+
+    return result;
+}
+
+/*
+ * Submits batches of small launches, each depending on up to four
+ * earlier launches of its batch, and counts heap allocations made by
+ * any thread once the task system has seen a few batches.  Task systems
+ * that recycle their launch records should make none.
+ */
+TestResults steadyStateAllocationsTest(ITaskSystem *t) {
+    const int num_warmup_batches = 16;
+    const int num_batches = 256;
+    const int batch_size = 64;
+    const int max_deps = 4;
+
+    // records that must be kept for profiles and hardware counters are
+    // not recycled
+    t->setProfiling(false);
+    t->setHardwareCounters(false);
+
+    CountTask task;
+    std::vector<TaskID> ids(batch_size);
+    std::vector<std::vector<TaskID>> deps(batch_size);
+    for (int i = 0; i < batch_size; i++) {
+        deps[i].reserve(max_deps);
+    }
+    long long expected_tasks = 0;
+    long long before = 0;
+
+    double start_time = CycleTimer::currentSeconds();
+    for (int b = 0; b < num_warmup_batches + num_batches; b++) {
+        if (b == num_warmup_batches) {
+            before = heapAllocations();
+            countAllocations(true);
+        }
+        for (int i = 0; i < batch_size; i++) {
+            deps[i].clear();
+            for (int d = 1; d <= (i + b) % (max_deps + 1) && d <= i; d++) {
+                deps[i].push_back(ids[i - d]);
+            }
+            int num_tasks = (i % 4) + 1;
+            ids[i] = t->runAsyncWithDeps(&task, num_tasks, deps[i]);
+            expected_tasks += num_tasks;
+        }
+        t->sync();
+    }
+    countAllocations(false);
+    long long allocations = heapAllocations() - before;
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = task.tasks_run == expected_tasks && allocations == 0;
+    if (allocations != 0) {
+        printf("%lld heap allocations in %d steady-state launches\n",
+               allocations, num_batches * batch_size);
+    }
+    result.time = end_time - start_time;
+    return result;
+}
+
 /*
  * These tests generates and run a random DAG of n tasks and at most m edges,
  * and make all dependencies are satisfied.
@@ -1403,3 +2081,580 @@ TestResults strictGraphDepsMedium(ITaskSystem* t) {
 TestResults strictGraphDepsLarge(ITaskSystem* t) {
     return strictGraphDepsTestBase(t,1000,20000,0);
 }
+
+// the same graph with implied dependencies dropped at submission
+TestResults strictGraphDepsLargeReduced(ITaskSystem* t) {
+    t->setDependencyReduction(true);
+    TestResults result = strictGraphDepsTestBase(t,1000,20000,0);
+    t->setDependencyReduction(false);
+    return result;
+}
+
+/*
+ * Submits a synthetic task graph generated from `spec` (see dag.h),
+ * one SyntheticDagTask per launch, and checks that every launch
+ * started only after all of its dependencies had finished.  Graph
+ * generation is not timed.
+ */
+TestResults dagTestBase(ITaskSystem *t, const DagSpec &spec) {
+    Dag dag = generateDag(spec);
+    int n = dag.deps.size();
+
+    // Each SyntheticDagTask sets this when it is complete.
+    bool *done = new bool[n]();
+
+    std::vector<std::vector<bool*> > flag_deps(n);
+    std::vector<IRunnable*> tasks;
+    for (int i = 0; i < n; i++) {
+        for (size_t j = 0; j < dag.deps[i].size(); j++) {
+            flag_deps[i].push_back(done + dag.deps[i][j]);
+        }
+        tasks.push_back(new SyntheticDagTask(flag_deps[i], done + i, spec, i));
+    }
+    std::vector<TaskID> task_ids(n);
+    std::vector<TaskID> task_deps;
+
+    double start_time = CycleTimer::currentSeconds();
+    for (int i = 0; i < n; i++) {
+        task_deps.clear();
+        for (size_t j = 0; j < dag.deps[i].size(); j++) {
+            task_deps.push_back(task_ids[dag.deps[i][j]]);
+        }
+        task_ids[i] = t->runAsyncWithDeps(tasks[i], dag.num_tasks[i], task_deps);
+    }
+    t->sync();
+    double end_time = CycleTimer::currentSeconds();
+
+    TestResults result;
+    result.passed = true;
+    for (int i = 0; i < n; i++) {
+        if (!done[i]) {
+            printf("launch %d: dependencies not met or not run\n", i);
+            result.passed = false;
+            break;
+        }
+    }
+    result.time = end_time - start_time;
+
+    delete[] done;
+    for (int i = 0; i < n; i++) {
+        delete tasks[i];
+    }
+    return result;
+}
+
+TestResults dagChainTest(ITaskSystem *t) {
+    DagSpec spec = { DAG_CHAIN, 1000, 1, 1, 1, 16, COST_CONSTANT, 5.0, 0 };
+    return dagTestBase(t, spec);
+}
+
+TestResults dagFanOutFanInTest(ITaskSystem *t) {
+    DagSpec spec = { DAG_FAN_OUT_FAN_IN, 1000, 16, 1, 1, 16, COST_EXPONENTIAL, 5.0, 1 };
+    return dagTestBase(t, spec);
+}
+
+TestResults dagBinaryTreeTest(ITaskSystem *t) {
+    DagSpec spec = { DAG_BINARY_TREE, 1023, 1, 1, 1, 16, COST_UNIFORM, 10.0, 2 };
+    return dagTestBase(t, spec);
+}
+
+TestResults dagLayeredTest(ITaskSystem *t) {
+    DagSpec spec = { DAG_LAYERED, 2000, 32, 3, 1, 16, COST_BIMODAL, 5.0, 3 };
+    return dagTestBase(t, spec);
+}
+
+TestResults dagSeriesParallelTest(ITaskSystem *t) {
+    DagSpec spec = { DAG_SERIES_PARALLEL, 2000, 1, 1, 1, 16, COST_EXPONENTIAL, 5.0, 4 };
+    return dagTestBase(t, spec);
+}
+
+TestResults dagRandomTest(ITaskSystem *t) {
+    DagSpec spec = { DAG_RANDOM, 2000, 1, 3, 1, 16, COST_UNIFORM, 5.0, 5 };
+    return dagTestBase(t, spec);
+}
+
+// one million single-task launches of no work: pure dependency overhead
+TestResults dagRandom1MTest(ITaskSystem *t) {
+    DagSpec spec = { DAG_RANDOM, 1000000, 1, 2, 1, 1, COST_ZERO, 0.0, 6 };
+    return dagTestBase(t, spec);
+}
+
+/*
+ * ==================================================================
+ *  Memory bandwidth tests.  Each test streams arrays much larger than
+ *  the last-level cache through a few flops per element, so its run
+ *  time is bound by DRAM bandwidth rather than by compute or
+ *  scheduling.  A test runs a number of passes over its arrays, each
+ *  split into blocks, and reports the bytes an ideal cache would move
+ *  (every element read or written once per pass, as STREAM counts
+ *  them) so the driver can report GB/s.
+ * ==================================================================
+ */
+
+#define BANDWIDTH_NUM_BLOCKS 64
+
+/*
+ * One pass of a bandwidth test.  As a bulk launch, task i computes
+ * block i of num_total_tasks.
+ */
+class BandwidthPass : public IRunnable {
+    public:
+        virtual ~BandwidthPass() {}
+        virtual void runBlock(int block, int num_blocks) = 0;
+        void runTask(int task_id, int num_total_tasks) {
+            runBlock(task_id, num_total_tasks);
+        }
+};
+
+// a single block of a pass, submitted as its own launch
+class BandwidthBlockTask : public IRunnable {
+    public:
+        BandwidthPass *pass;
+        int block;
+        int num_blocks;
+        BandwidthBlockTask(BandwidthPass *pass, int block, int num_blocks)
+            : pass(pass), block(block), num_blocks(num_blocks) {}
+        void runTask(int task_id, int num_total_tasks) {
+            pass->runBlock(block, num_blocks);
+        }
+};
+
+// first element of block `block` when n elements are split into num_blocks
+inline long blockStart(long n, int block, int num_blocks) {
+    return n * block / num_blocks;
+}
+
+/*
+ * Runs the passes in order and returns the elapsed time.  Sync runs
+ * each pass as one launch of num_blocks tasks.  Async submits each
+ * block of a pass as its own launch depending only on blocks
+ * [b - halo, b + halo] of the previous pass, so that passes can
+ * overlap instead of meeting at a barrier; a negative halo makes each
+ * pass a single launch depending on the whole previous pass.
+ */
+double runBandwidthPasses(ITaskSystem *t, const std::vector<BandwidthPass*> &passes,
+                          int num_blocks, int halo, bool do_async) {
+    std::vector<BandwidthBlockTask> blocks;
+    if (do_async && halo >= 0) {
+        for (size_t p = 0; p < passes.size(); p++) {
+            for (int b = 0; b < num_blocks; b++) {
+                blocks.push_back(BandwidthBlockTask(passes[p], b, num_blocks));
+            }
+        }
+    }
+
+    double start_time = CycleTimer::currentSeconds();
+    if (!do_async) {
+        for (size_t p = 0; p < passes.size(); p++) {
+            t->run(passes[p], num_blocks);
+        }
+    } else if (halo < 0) {
+        std::vector<TaskID> deps;
+        for (size_t p = 0; p < passes.size(); p++) {
+            TaskID id = t->runAsyncWithDeps(passes[p], num_blocks, deps);
+            deps.assign(1, id);
+        }
+        t->sync();
+    } else {
+        std::vector<TaskID> prev(num_blocks), cur(num_blocks);
+        std::vector<TaskID> deps;
+        for (size_t p = 0; p < passes.size(); p++) {
+            for (int b = 0; b < num_blocks; b++) {
+                deps.clear();
+                if (p > 0) {
+                    for (int d = std::max(0, b - halo); d <= std::min(num_blocks - 1, b + halo); d++) {
+                        deps.push_back(prev[d]);
+                    }
+                }
+                cur[b] = t->runAsyncWithDeps(&blocks[p * num_blocks + b], 1, deps);
+            }
+            prev.swap(cur);
+        }
+        t->sync();
+    }
+    return CycleTimer::currentSeconds() - start_time;
+}
+
+// dst[i] = src[i] + scalar * c[i]
+class StreamTriadPass : public BandwidthPass {
+    public:
+        double *dst;
+        const double *src;
+        const double *c;
+        double scalar;
+        long n;
+        StreamTriadPass(double *dst, const double *src, const double *c, double scalar, long n)
+            : dst(dst), src(src), c(c), scalar(scalar), n(n) {}
+        void runBlock(int block, int num_blocks) {
+            long end = blockStart(n, block + 1, num_blocks);
+            for (long i = blockStart(n, block, num_blocks); i < end; i++) {
+                dst[i] = src[i] + scalar * c[i];
+            }
+        }
+};
+
+/*
+ * Bandwidth: the STREAM triad over three arrays of 64 MB each, the
+ * source and destination swapping every pass.  Each async block
+ * depends only on the same block of the previous pass.
+ */
+TestResults streamTriadTestBase(ITaskSystem *t, bool do_async) {
+    const long n = 1 << 23;
+    const int num_passes = 10;
+    const double scalar = 3.0;
+
+    double *x = new double[n];
+    double *y = new double[n];
+    double *c = new double[n];
+    for (long i = 0; i < n; i++) {
+        x[i] = 1.0;
+        y[i] = 0.0;
+        c[i] = (i % 7) * 0.25;
+    }
+
+    std::vector<BandwidthPass*> passes;
+    for (int p = 0; p < num_passes; p++) {
+        passes.push_back(p % 2 == 0 ? new StreamTriadPass(y, x, c, scalar, n)
+                                    : new StreamTriadPass(x, y, c, scalar, n));
+    }
+
+    TestResults result;
+    result.time = runBandwidthPasses(t, passes, BANDWIDTH_NUM_BLOCKS, 0, do_async);
+    result.bytes = 3.0 * sizeof(double) * n * num_passes;
+
+    // c takes 7 distinct values, so there are 7 distinct results
+    double expected[7];
+    for (int k = 0; k < 7; k++) {
+        double v = 1.0;
+        for (int p = 0; p < num_passes; p++) {
+            v = v + scalar * (k * 0.25);
+        }
+        expected[k] = v;
+    }
+    const double *out = num_passes % 2 == 0 ? x : y;
+    result.passed = true;
+    for (long i = 0; i < n; i++) {
+        if (fabs(out[i] - expected[i % 7]) > 1e-9 * expected[i % 7]) {
+            printf("%ld: %f expected=%f\n", i, out[i], expected[i % 7]);
+            result.passed = false;
+            break;
+        }
+    }
+
+    for (size_t p = 0; p < passes.size(); p++) {
+        delete passes[p];
+    }
+    delete[] x;
+    delete[] y;
+    delete[] c;
+    return result;
+}
+
+TestResults streamTriadTest(ITaskSystem *t) {
+    return streamTriadTestBase(t, false);
+}
+
+TestResults streamTriadAsyncTest(ITaskSystem *t) {
+    return streamTriadTestBase(t, true);
+}
+
+// one Jacobi sweep over the interior rows of an n x n grid
+class Jacobi2DPass : public BandwidthPass {
+    public:
+        double *dst;
+        const double *src;
+        long n;
+        Jacobi2DPass(double *dst, const double *src, long n) : dst(dst), src(src), n(n) {}
+        void runBlock(int block, int num_blocks) {
+            long end = 1 + blockStart(n - 2, block + 1, num_blocks);
+            for (long i = 1 + blockStart(n - 2, block, num_blocks); i < end; i++) {
+                const double *row = src + i * n;
+                double *out = dst + i * n;
+                for (long j = 1; j < n - 1; j++) {
+                    out[j] = 0.25 * (row[j - n] + row[j + n] + row[j - 1] + row[j + 1]);
+                }
+            }
+        }
+};
+
+// one Jacobi sweep over the interior planes of an n x n x n grid
+class Jacobi3DPass : public BandwidthPass {
+    public:
+        double *dst;
+        const double *src;
+        long n;
+        Jacobi3DPass(double *dst, const double *src, long n) : dst(dst), src(src), n(n) {}
+        void runBlock(int block, int num_blocks) {
+            const long plane = n * n;
+            const double sixth = 1.0 / 6.0;
+            long end = 1 + blockStart(n - 2, block + 1, num_blocks);
+            for (long k = 1 + blockStart(n - 2, block, num_blocks); k < end; k++) {
+                for (long i = 1; i < n - 1; i++) {
+                    const double *row = src + k * plane + i * n;
+                    double *out = dst + k * plane + i * n;
+                    for (long j = 1; j < n - 1; j++) {
+                        out[j] = sixth * (row[j - plane] + row[j + plane] + row[j - n] +
+                                          row[j + n] + row[j - 1] + row[j + 1]);
+                    }
+                }
+            }
+        }
+};
+
+/*
+ * Bandwidth: Jacobi iterations of a 5-point (2D) or 7-point (3D)
+ * stencil, ping-ponging between two grids of about 32 MB each.  Blocks
+ * are bands of rows (2D) or planes (3D).  An async block depends on
+ * its own band and its two neighbours in the previous pass, which
+ * covers both the halo it reads and the band it overwrites.  The
+ * result is checked against the same sweeps run serially.
+ */
+TestResults jacobiTestBase(ITaskSystem *t, int dims, bool do_async) {
+    const long n = dims == 2 ? 2048 : 160;
+    const long size = dims == 2 ? n * n : n * n * n;
+    const int num_passes = 10;
+
+    double *a = new double[size];
+    double *b = new double[size];
+    double *ref_a = new double[size];
+    double *ref_b = new double[size];
+    for (long i = 0; i < size; i++) {
+        // boundary values of both grids never change
+        a[i] = b[i] = ref_a[i] = ref_b[i] = (dagMix(i) % 1000) * 0.001;
+    }
+
+    std::vector<BandwidthPass*> passes;
+    std::vector<BandwidthPass*> ref_passes;
+    for (int p = 0; p < num_passes; p++) {
+        bool even = p % 2 == 0;
+        if (dims == 2) {
+            passes.push_back(even ? new Jacobi2DPass(b, a, n) : new Jacobi2DPass(a, b, n));
+            ref_passes.push_back(even ? new Jacobi2DPass(ref_b, ref_a, n)
+                                      : new Jacobi2DPass(ref_a, ref_b, n));
+        } else {
+            passes.push_back(even ? new Jacobi3DPass(b, a, n) : new Jacobi3DPass(a, b, n));
+            ref_passes.push_back(even ? new Jacobi3DPass(ref_b, ref_a, n)
+                                      : new Jacobi3DPass(ref_a, ref_b, n));
+        }
+    }
+
+    TestResults result;
+    result.time = runBandwidthPasses(t, passes, BANDWIDTH_NUM_BLOCKS, 1, do_async);
+    // each pass reads one grid and writes the other
+    result.bytes = 2.0 * sizeof(double) * size * num_passes;
+
+    for (int p = 0; p < num_passes; p++) {
+        ref_passes[p]->runBlock(0, 1);
+    }
+    result.passed = true;
+    for (long i = 0; i < size; i++) {
+        if (a[i] != ref_a[i] || b[i] != ref_b[i]) {
+            printf("%ld: %f %f expected=%f %f\n", i, a[i], b[i], ref_a[i], ref_b[i]);
+            result.passed = false;
+            break;
+        }
+    }
+
+    for (int p = 0; p < num_passes; p++) {
+        delete passes[p];
+        delete ref_passes[p];
+    }
+    delete[] a;
+    delete[] b;
+    delete[] ref_a;
+    delete[] ref_b;
+    return result;
+}
+
+TestResults jacobi2DTest(ITaskSystem *t) {
+    return jacobiTestBase(t, 2, false);
+}
+
+TestResults jacobi2DAsyncTest(ITaskSystem *t) {
+    return jacobiTestBase(t, 2, true);
+}
+
+TestResults jacobi3DTest(ITaskSystem *t) {
+    return jacobiTestBase(t, 3, false);
+}
+
+TestResults jacobi3DAsyncTest(ITaskSystem *t) {
+    return jacobiTestBase(t, 3, true);
+}
+
+// dst[i] = src[index[i]]
+class GatherPass : public BandwidthPass {
+    public:
+        double *dst;
+        const double *src;
+        const int *index;
+        long n;
+        GatherPass(double *dst, const double *src, const int *index, long n)
+            : dst(dst), src(src), index(index), n(n) {}
+        void runBlock(int block, int num_blocks) {
+            long end = blockStart(n, block + 1, num_blocks);
+            for (long i = blockStart(n, block, num_blocks); i < end; i++) {
+                dst[i] = src[index[i]];
+            }
+        }
+};
+
+// dst[index[i]] = src[i] + 1
+class ScatterPass : public BandwidthPass {
+    public:
+        double *dst;
+        const double *src;
+        const int *index;
+        long n;
+        ScatterPass(double *dst, const double *src, const int *index, long n)
+            : dst(dst), src(src), index(index), n(n) {}
+        void runBlock(int block, int num_blocks) {
+            long end = blockStart(n, block + 1, num_blocks);
+            for (long i = blockStart(n, block, num_blocks); i < end; i++) {
+                dst[index[i]] = src[i] + 1.0;
+            }
+        }
+};
+
+/*
+ * Bandwidth: alternating gather and scatter through a random
+ * permutation of 8M elements, so nearly every access to the permuted
+ * array touches a different cache line.  Reported bandwidth counts
+ * only the useful bytes: the index and one element read and one
+ * element written per entry.  Every block of a pass may touch any
+ * element, so async passes are whole launches chained in order.
+ */
+TestResults gatherScatterTestBase(ITaskSystem *t, bool do_async) {
+    const long n = 1 << 23;
+    const int num_round_trips = 2;
+
+    int *index = new int[n];
+    double *x = new double[n];
+    double *y = new double[n];
+    DagRandom rng(7);
+    for (long i = 0; i < n; i++) {
+        index[i] = i;
+        x[i] = i * 0.5;
+    }
+    for (long i = n - 1; i > 0; i--) {
+        std::swap(index[i], index[rng.below(i + 1)]);
+    }
+
+    std::vector<BandwidthPass*> passes;
+    for (int r = 0; r < num_round_trips; r++) {
+        passes.push_back(new GatherPass(y, x, index, n));
+        passes.push_back(new ScatterPass(x, y, index, n));
+    }
+
+    TestResults result;
+    result.time = runBandwidthPasses(t, passes, BANDWIDTH_NUM_BLOCKS, -1, do_async);
+    result.bytes = (sizeof(int) + 2.0 * sizeof(double)) * n * passes.size();
+
+    // every round trip moves each element back to its place plus one
+    result.passed = true;
+    for (long i = 0; i < n; i++) {
+        double expected = i * 0.5 + num_round_trips;
+        if (x[i] != expected) {
+            printf("%ld: %f expected=%f\n", i, x[i], expected);
+            result.passed = false;
+            break;
+        }
+    }
+
+    for (size_t p = 0; p < passes.size(); p++) {
+        delete passes[p];
+    }
+    delete[] index;
+    delete[] x;
+    delete[] y;
+    return result;
+}
+
+TestResults gatherScatterTest(ITaskSystem *t) {
+    return gatherScatterTestBase(t, false);
+}
+
+TestResults gatherScatterAsyncTest(ITaskSystem *t) {
+    return gatherScatterTestBase(t, true);
+}
+
+/*
+ * I/O: writes 4 frames of 1600x1200 iteration counts as PPM images
+ * with writePPMImageParallel() and reports the bytes written, so the
+ * driver prints the write bandwidth in MB/s.  The last frame is read
+ * back and compared with the tone mapping of writePPMImage().
+ */
+TestResults ppmWriteTestBase(ITaskSystem *t, PPMWriteMode mode) {
+    const int width = 1600;
+    const int height = 1200;
+    const int max_iterations = 256;
+    const int num_frames = 4;
+
+    // every count from 0 to max_iterations, in no particular order
+    int *counts = new int[width * height];
+    for (int i = 0; i < width * height; i++) {
+        counts[i] = dagMix(i) % (max_iterations + 1);
+    }
+    char filenames[num_frames][64];
+    for (int f = 0; f < num_frames; f++) {
+        snprintf(filenames[f], sizeof(filenames[f]), "ppm_write_test_%d.ppm", f);
+    }
+
+    TestResults result;
+    result.passed = true;
+    result.bytes = 0;
+    result.report_mb = true;
+    double start_time = CycleTimer::currentSeconds();
+    for (int f = 0; f < num_frames; f++) {
+        PPMWriteStats stats;
+        if (!writePPMImageParallel(t, counts, width, height, filenames[f],
+                                   max_iterations, mode, &stats)) {
+            result.passed = false;
+            break;
+        }
+        result.bytes += stats.bytes;
+    }
+    double end_time = CycleTimer::currentSeconds();
+    result.time = end_time - start_time;
+
+    if (result.passed) {
+        char header[64];
+        int header_size = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+        std::vector<unsigned char> file(header_size + 3 * width * height + 1);
+        FILE *fp = fopen(filenames[num_frames - 1], "rb");
+        size_t size = fp ? fread(file.data(), 1, file.size(), fp) : 0;
+        if (fp) {
+            fclose(fp);
+        }
+        if (size != file.size() - 1 || memcmp(file.data(), header, header_size) != 0) {
+            printf("%s: wrong size or header\n", filenames[num_frames - 1]);
+            result.passed = false;
+        }
+        for (int i = 0; result.passed && i < width * height; i++) {
+            float mapped = pow(std::min(static_cast<float>(max_iterations),
+                                        static_cast<float>(counts[i])) / 256.f, .5f);
+            unsigned char expected = static_cast<unsigned char>(255.f * mapped);
+            for (int c = 0; c < 3; c++) {
+                if (file[header_size + 3 * i + c] != expected) {
+                    printf("%d: %d expected=%d\n", i, file[header_size + 3 * i + c], expected);
+                    result.passed = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int f = 0; f < num_frames; f++) {
+        remove(filenames[f]);
+    }
+    delete[] counts;
+    return result;
+}
+
+TestResults ppmWriteTest(ITaskSystem *t) {
+    return ppmWriteTestBase(t, PPM_WRITE_BUFFERED);
+}
+
+TestResults ppmWriteMmapTest(ITaskSystem *t) {
+    return ppmWriteTestBase(t, PPM_WRITE_MMAP);
+}